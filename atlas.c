@@ -0,0 +1,330 @@
+/*=======================*
+ |     Sprite Atlas      |
+ *=======================*/
+
+/* All gameplay sprites (note gems, lane decorations, effect frames) are
+ * packed into one texture with a table of source rects, and drawn through
+ * a spritebatch: quads pile up in a vertex buffer and go out in a single
+ * SDL_RenderGeometry call. More sprites on screen means more vertices,
+ * not more texture switches or draw calls.
+ *
+ * Sprites are loaded from assets/<name>.bmp when that file exists, and
+ * generated here otherwise. Sprites are white/grey so the vertex color
+ * can tint them.
+ *
+ * Quads are positioned in logical pixels and texture coordinates come
+ * from the source rects, so the atlas can be built at any scale. It's
+ * built at the window's scale, which keeps sprites sharp on big panels
+ * without the renderer stretching them every frame.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "atlas.h"
+#include "hud.h"
+
+const char* spriteNames[] = {
+  "white",
+  "gem",
+  "player",
+  "lane",
+  "particle"
+};
+
+
+/*==========< newSprite >===========*
+ * Blank (transparent) RGBA surface *
+ *==================================*/
+static SDL_Surface *newSprite(int w, int h) {
+  SDL_Surface *s = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32,
+                                                  SDL_PIXELFORMAT_RGBA32);
+  if (s) SDL_FillRect(s, NULL, SDL_MapRGBA(s->format, 0, 0, 0, 0));
+  return s;
+}
+
+static void putPixel(SDL_Surface *s, int x, int y, Uint8 v, Uint8 alpha) {
+  Uint32 *row = (Uint32*)((Uint8*)s->pixels + y*s->pitch);
+  row[x] = SDL_MapRGBA(s->format, v, v, v, alpha);
+}
+
+
+/*==========< generateSprite >===========*
+ * Procedural stand-in for each sprite,  *
+ * used when there's no BMP for it. The  *
+ * shapes are described in logical       *
+ * pixels and sampled at scale.          *
+ *=======================================*/
+static SDL_Surface *generateSprite(int sprite, float scale) {
+  SDL_Surface *s = NULL;
+
+  // Logical coordinate of the center of texture pixel p
+#define AT(p) (((p) + 0.5f)/scale - 0.5f)
+
+  switch (sprite) {
+    case SPRITE_WHITE:
+      s = newSprite(4, 4);
+      if (s) SDL_FillRect(s, NULL, SDL_MapRGBA(s->format, 255,255,255,255));
+      break;
+
+    /* Rounded gem, lighter on top with a darker rim */
+    case SPRITE_GEM:
+      s = newSprite(50*scale + 0.5f, 25*scale + 0.5f);
+      if (s == NULL) break;
+      for (int py=0; py<s->h; py++) {
+        for (int px=0; px<s->w; px++) {
+          float x = AT(px), y = AT(py);
+          float dx = (x < 6) ? 6-x : (x > 43) ? x-43 : 0;
+          float dy = (y < 6) ? 6-y : (y > 18) ? y-18 : 0;
+          if (dx*dx + dy*dy > 36) continue;                 // Corner
+          int rim = (x < 2 || x > 47 || y < 2 || y > 22 ||
+                     dx*dx + dy*dy > 16);
+          putPixel(s, px, py, rim ? 150 : 255 - (int)(y*2), 255);
+        }
+      }
+      break;
+
+    /* Flat block with a 2px highlight border */
+    case SPRITE_PLAYER:
+      s = newSprite(50*scale + 0.5f, 25*scale + 0.5f);
+      if (s == NULL) break;
+      for (int py=0; py<s->h; py++) {
+        for (int px=0; px<s->w; px++) {
+          float x = AT(px), y = AT(py);
+          putPixel(s, px, py,
+                   (x < 2 || x > 47 || y < 2 || y > 22) ? 255 : 220, 255);
+        }
+      }
+      break;
+
+    /* Thin line with soft edges; only the width matters, it's stretched */
+    case SPRITE_LANE:
+      s = newSprite(4*scale + 0.5f, 16);
+      if (s == NULL) break;
+      for (int py=0; py<16; py++) {
+        for (int px=0; px<s->w; px++) {
+          float x = AT(px);
+          putPixel(s, px, py, 255, (x < 0.5f || x > 2.5f) ? 64 : 255);
+        }
+      }
+      break;
+
+    /* Radial falloff dot */
+    case SPRITE_PARTICLE:
+      s = newSprite(8*scale + 0.5f, 8*scale + 0.5f);
+      if (s == NULL) break;
+      for (int py=0; py<s->h; py++) {
+        for (int px=0; px<s->w; px++) {
+          double d = hypot(AT(px)-3.5, AT(py)-3.5)/4.0;
+          if (d < 1) putPixel(s, px, py, 255, (Uint8)(255*(1-d)*(1-d)));
+        }
+      }
+      break;
+  }
+#undef AT
+  return s;
+}
+
+
+/*===========< loadSprite >============*
+ * assets/<name>.bmp if it's there,    *
+ * otherwise the generated sprite.     *
+ * BMPs are drawn at logical size and  *
+ * resampled once here for scale.      *
+ *=====================================*/
+static SDL_Surface *loadSprite(int sprite, float scale) {
+  char path[64];
+  SDL_Surface *bmp, *rgba, *scaled;
+
+  snprintf(path, sizeof(path), "assets/%s.bmp", spriteNames[sprite]);
+  bmp = SDL_LoadBMP(path);
+  if (bmp == NULL) return generateSprite(sprite, scale);
+
+  rgba = SDL_ConvertSurfaceFormat(bmp, SDL_PIXELFORMAT_RGBA32, 0);
+  SDL_FreeSurface(bmp);
+  if (rgba == NULL) return generateSprite(sprite, scale);
+  if (scale == 1) return rgba;
+
+  scaled = newSprite(rgba->w*scale + 0.5f, rgba->h*scale + 0.5f);
+  if (scaled && SDL_SoftStretchLinear(rgba, NULL, scaled, NULL) != 0) {
+    SDL_FreeSurface(scaled);
+    scaled = NULL;
+  }
+  SDL_FreeSurface(rgba);
+  return scaled ? scaled : generateSprite(sprite, scale);
+}
+
+
+/*================< atlasLoad >=================*
+ * Load every sprite at scale, shelf-pack them  *
+ * (tallest first) into one surface and upload  *
+ * it. Returns 0 on success.                    *
+ *==============================================*/
+int atlasLoad(atlas *a, SDL_Renderer *renderer, float scale) {
+  SDL_Surface *sprites[NUM_SPRITES];
+  SDL_Surface *sheet;
+  int order[NUM_SPRITES];
+  int x = ATLAS_PADDING, y = ATLAS_PADDING, shelf = 0;
+  int width = (int)ceilf(ATLAS_WIDTH*scale);
+  int status = 1;
+
+  memset(a, 0, sizeof(*a));
+  for (int i=0; i<NUM_SPRITES; i++) {
+    sprites[i] = loadSprite(i, scale);
+    order[i] = i;
+    if (sprites[i] == NULL) goto done;
+  }
+
+  // Sort by height (insertion sort, there are only a handful)
+  for (int i=1; i<NUM_SPRITES; i++) {
+    int j = i, cur = order[i];
+    for (; j > 0 && sprites[order[j-1]]->h < sprites[cur]->h; j--)
+      order[j] = order[j-1];
+    order[j] = cur;
+  }
+
+  // Place left to right, starting a new shelf when a row fills up
+  for (int i=0; i<NUM_SPRITES; i++) {
+    SDL_Surface *s = sprites[order[i]];
+    if (x + s->w + ATLAS_PADDING > width) {
+      x = ATLAS_PADDING;
+      y += shelf + ATLAS_PADDING;
+      shelf = 0;
+    }
+    a->rects[order[i]] = (SDL_Rect){x, y, s->w, s->h};
+    x += s->w + ATLAS_PADDING;
+    if (s->h > shelf) shelf = s->h;
+  }
+  a->w = width;
+  a->h = y + shelf + ATLAS_PADDING;
+
+  sheet = newSprite(a->w, a->h);
+  if (sheet == NULL) goto done;
+  for (int i=0; i<NUM_SPRITES; i++) {
+    SDL_Rect dst = a->rects[i];
+    SDL_SetSurfaceBlendMode(sprites[i], SDL_BLENDMODE_NONE);  // Copy alpha
+    SDL_BlitSurface(sprites[i], NULL, sheet, &dst);
+  }
+
+  a->texture = SDL_CreateTextureFromSurface(renderer, sheet);
+  SDL_FreeSurface(sheet);
+  if (a->texture) {
+    SDL_SetTextureBlendMode(a->texture, SDL_BLENDMODE_BLEND);
+    perf.textures++;
+    status = 0;
+  }
+
+  // Sample the middle of the solid sprite so stretching never bleeds
+  a->rects[SPRITE_WHITE].x += 1;
+  a->rects[SPRITE_WHITE].y += 1;
+  a->rects[SPRITE_WHITE].w -= 2;
+  a->rects[SPRITE_WHITE].h -= 2;
+
+done:
+  for (int i=0; i<NUM_SPRITES && sprites[i]; i++)
+    SDL_FreeSurface(sprites[i]);
+  return status;
+}
+
+
+/*=========< atlasFree >==========*
+ * Release the atlas texture.     *
+ *================================*/
+void atlasFree(atlas *a) {
+  if (a->texture) {
+    SDL_DestroyTexture(a->texture);
+    perf.textures--;
+  }
+  a->texture = NULL;
+}
+
+
+/*================< batchSprite >=================*
+ * Queue sprite stretched over (x, y, w, h),      *
+ * tinted by color. Nothing is drawn until        *
+ * batchFlush.                                    *
+ *================================================*/
+void batchSprite(spritebatch *b, const atlas *a, int sprite,
+                 float x, float y, float w, float h, SDL_Color color) {
+  SDL_FPoint corners[4] = {{x, y}, {x+w, y}, {x+w, y+h}, {x, y+h}};
+  batchQuad(b, a, sprite, corners, color);
+}
+
+
+/*=================< batchQuad >==================*
+ * Queue sprite mapped onto any four corners      *
+ * (top left, top right, bottom right, bottom     *
+ * left), e.g. a trapezoid in perspective.        *
+ *================================================*/
+void batchQuad(spritebatch *b, const atlas *a, int sprite,
+               const SDL_FPoint corners[4], SDL_Color color) {
+  batchRect(b, a->w, a->h, &a->rects[sprite], corners, color);
+}
+
+
+/*=================< batchRect >==================*
+ * Queue the src rect of a tex_w x tex_h texture  *
+ * onto four corners. For textures other than     *
+ * the sprite atlas (e.g. glyph strips).          *
+ *================================================*/
+void batchRect(spritebatch *b, int tex_w, int tex_h, const SDL_Rect *src,
+               const SDL_FPoint corners[4], SDL_Color color) {
+  float u0 = (float)src->x/tex_w, u1 = (float)(src->x + src->w)/tex_w;
+  float v0 = (float)src->y/tex_h, v1 = (float)(src->y + src->h)/tex_h;
+  SDL_Vertex *v;
+  int *idx, base;
+
+  // Grow both buffers together
+  if (b->num_quads == b->max_quads) {
+    int max = b->max_quads ? b->max_quads*2 : 256;
+    SDL_Vertex *verts = realloc(b->verts, max*4*sizeof(SDL_Vertex));
+    int *indices = verts ? realloc(b->indices, max*6*sizeof(int)) : NULL;
+    if (verts) b->verts = verts;
+    if (indices == NULL) return;
+    b->indices = indices;
+    b->max_quads = max;
+  }
+
+  base = b->num_quads*4;
+  v = &b->verts[base];
+  v[0] = (SDL_Vertex){corners[0], color, {u0, v0}};
+  v[1] = (SDL_Vertex){corners[1], color, {u1, v0}};
+  v[2] = (SDL_Vertex){corners[2], color, {u1, v1}};
+  v[3] = (SDL_Vertex){corners[3], color, {u0, v1}};
+
+  idx = &b->indices[b->num_quads*6];
+  idx[0] = base;   idx[1] = base+1; idx[2] = base+2;
+  idx[3] = base;   idx[4] = base+2; idx[5] = base+3;
+  b->num_quads++;
+}
+
+
+/*================< batchDraw >==================*
+ * Draw everything queued in one call, and keep  *
+ * it queued (e.g. to draw it again under a      *
+ * different clip rect).                         *
+ *===============================================*/
+void batchDraw(const spritebatch *b, SDL_Renderer *renderer,
+               const atlas *a) {
+  if (b->num_quads == 0) return;
+  SDL_RenderGeometry(renderer, a->texture, b->verts, b->num_quads*4,
+                     b->indices, b->num_quads*6);
+  perf.draw_calls++;
+}
+
+
+/*================< batchFlush >=================*
+ * Draw everything queued and empty the batch.   *
+ *===============================================*/
+void batchFlush(spritebatch *b, SDL_Renderer *renderer, const atlas *a) {
+  batchDraw(b, renderer, a);
+  b->num_quads = 0;
+}
+
+void batchFree(spritebatch *b) {
+  free(b->verts);
+  free(b->indices);
+  memset(b, 0, sizeof(*b));
+}
@@ -0,0 +1,51 @@
+/* Sprite Atlas */
+
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <SDL2/SDL.h>
+
+#define ATLAS_WIDTH   256   // Atlas grows downward from this width (x scale)
+#define ATLAS_PADDING 2     // Empty pixels around each sprite (no bleeding)
+
+/* Every gameplay sprite lives in one texture */
+enum {
+  SPRITE_WHITE,       // Solid fill; tint with the vertex color
+  SPRITE_GEM,         // Falling note head
+  SPRITE_PLAYER,      // Rectangle under the note being played
+  SPRITE_LANE,        // Lane separator, stretched vertically
+  SPRITE_PARTICLE,    // Soft dot for particle effects
+  NUM_SPRITES
+};
+
+typedef struct {
+  SDL_Texture *texture;
+  int w, h;                       // Texture size
+  SDL_Rect rects[NUM_SPRITES];    // Source rect of each sprite
+} atlas;
+
+/* Quads waiting to be drawn from an atlas in one SDL_RenderGeometry */
+typedef struct {
+  SDL_Vertex *verts;
+  int *indices;
+  int num_quads;
+  int max_quads;
+} spritebatch;
+
+extern const char* spriteNames[];
+
+int atlasLoad(atlas *a, SDL_Renderer *renderer, float scale);
+void atlasFree(atlas *a);
+
+void batchSprite(spritebatch *b, const atlas *a, int sprite,
+                 float x, float y, float w, float h, SDL_Color color);
+void batchQuad(spritebatch *b, const atlas *a, int sprite,
+               const SDL_FPoint corners[4], SDL_Color color);
+void batchRect(spritebatch *b, int tex_w, int tex_h, const SDL_Rect *src,
+               const SDL_FPoint corners[4], SDL_Color color);
+void batchDraw(const spritebatch *b, SDL_Renderer *renderer,
+               const atlas *a);
+void batchFlush(spritebatch *b, SDL_Renderer *renderer, const atlas *a);
+void batchFree(spritebatch *b);
+
+#endif
@@ -0,0 +1,104 @@
+/*=======================*
+ |    Audience Window    |
+ *=======================*/
+
+/* At events the game is mirrored to a big screen. The audience window
+ * shows the highway and the score (no title, pitch label or perf HUD),
+ * drawn by the render thread from the same snapshot as the player's
+ * window.
+ *
+ * It doesn't lay anything out itself: the player view's render queue is
+ * already built and sorted, so it's drawn again here with each texture
+ * swapped for this renderer's copy. SDL renderers can't share textures,
+ * so the atlas and score glyphs are built twice, at the player view's
+ * scale so the source rects match. A second 60 Hz window costs one more
+ * set of draw calls, not another frame of CPU work.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "audience.h"
+#include "game.h"
+#include "hud.h"
+
+
+/*=============< loadCopies >=============*
+ * This renderer's copies of the atlas    *
+ * and score glyphs, and the map to them. *
+ *========================================*/
+static int loadCopies(audience *a, float scale) {
+  a->num_pairs = 0;
+  if (atlasLoad(&a->sprites, a->renderer, scale)) return 1;
+  a->map[a->num_pairs++] =
+    (texturepair){game_atlas.texture, a->sprites.texture};
+
+  if (score_digits.texture &&
+      digitsInit(&a->score, a->renderer, FONT_PATH, SCORE_FONT_SIZE, NULL,
+                 scale) == 0)
+    a->map[a->num_pairs++] =
+      (texturepair){score_digits.texture, a->score.texture};
+  return 0;
+}
+
+static void freeCopies(audience *a) {
+  atlasFree(&a->sprites);
+  digitsFree(&a->score);
+  a->num_pairs = 0;
+}
+
+
+/*===============< audienceInit >================*
+ * Renderer for window with render driver, and   *
+ * copies of the player view's textures, made at *
+ * scale. Call after the player view's assets    *
+ * are loaded. Returns 0 on success.             *
+ *===============================================*/
+int audienceInit(audience *a, SDL_Window *window, int driver, float scale) {
+  memset(a, 0, sizeof(*a));
+  a->window = window;
+
+  /* No vsync: the player's window already paces the loop, and waiting on
+   * two vblanks a frame would halve the frame rate */
+  a->renderer = SDL_CreateRenderer(window, driver, 0);
+  if (a->renderer == NULL) return 1;
+  SDL_RenderSetLogicalSize(a->renderer, WIDTH, HEIGHT);
+
+  if (loadCopies(a, scale)) {
+    audienceFree(a);
+    return 1;
+  }
+  return 0;
+}
+
+
+/*=============< audienceRescale >==============*
+ * Rebuild the copies after the player view's   *
+ * assets were rebuilt at a new scale.          *
+ *==============================================*/
+int audienceRescale(audience *a, float scale) {
+  freeCopies(a);
+  return loadCopies(a, scale);
+}
+
+
+/*===============< audienceDraw >================*
+ * Show the frame the player view just queued.   *
+ * Call after renderFrame/renderDirty, before    *
+ * the next frame is queued.                     *
+ *===============================================*/
+void audienceDraw(audience *a, const gamestate *state) {
+  if (a->renderer == NULL) return;
+  if (SDL_GetWindowFlags(a->window) & SDL_WINDOW_HIDDEN) return;   // Closed
+  drawBackground(a->renderer, state);
+  if (!state->menu.active)    // Nobody needs to watch the song search
+    queueMirror(&frame_queue, a->renderer, a->map, a->num_pairs, LAYER_WORLD);
+  SDL_RenderPresent(a->renderer);
+}
+
+
+void audienceFree(audience *a) {
+  freeCopies(a);
+  if (a->renderer) SDL_DestroyRenderer(a->renderer);
+  a->renderer = NULL;
+}
@@ -0,0 +1,27 @@
+/* Audience Window */
+
+#ifndef AUDIENCE_H
+#define AUDIENCE_H
+
+#include <SDL2/SDL.h>
+
+#include "atlas.h"
+#include "digits.h"
+#include "state.h"
+
+/* Second window mirroring the highway and score for a crowd */
+typedef struct {
+  SDL_Window *window;
+  SDL_Renderer *renderer;
+  atlas sprites;              // Copies of the player view's textures
+  digitatlas score;
+  texturepair map[2];
+  int num_pairs;
+} audience;
+
+int audienceInit(audience *a, SDL_Window *window, int driver, float scale);
+int audienceRescale(audience *a, float scale);
+void audienceDraw(audience *a, const gamestate *state);
+void audienceFree(audience *a);
+
+#endif
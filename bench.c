@@ -0,0 +1,203 @@
+/*=======================*
+ |   Render Benchmark    |
+ *=======================*/
+
+/* Runs the game's real render path (renderFrame) against a synthetic
+ * dense chart, into an offscreen surface through SDL's software renderer.
+ * No window, no audio device, no display needed, so it runs on CI.
+ *
+ *   ./theremin --bench [frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+#include "bench.h"
+#include "hud.h"
+#include "text.h"
+#include "particles.h"
+#include "highway.h"
+#include "chart.h"
+
+// Whether the HUD loaded; the game's own hud_visible belongs to main
+static int bench_hud = 0;
+
+
+/*===========< makeSyntheticChart >============*
+ * Build a chart of short notes hopping around *
+ * all the lanes, so the screen stays full.    *
+ * Returns 0 on success.                       *
+ *=============================================*/
+static int makeSyntheticChart(notearena *notes, int count) {
+  if (allocNotes(notes, count)) return 1;
+
+  for (int i=0; i<count; i++) {
+    notes->pitch[i] = (i*5)%NUM_PITCHES;
+    notes->start[i] = (i > 0) ? notes->end[i-1] : 0;
+    notes->end[i] = notes->start[i] +     // 1-4 frames: ~60 notes on screen
+                    (1 + i%4)*TIMELINE_RATE/60;
+  }
+  notes->count = count;
+  markSustains(notes);
+  return 0;
+}
+
+
+/*=============< benchmarkRenderer >==============*
+ * Render frames frames of the synthetic chart on *
+ * renderer and return the frames per second.     *
+ * perspective picks the flat or tilted highway.  *
+ * stage_ms (NUM_STAGES long, or NULL) gets the   *
+ * average time per stage.                        *
+ *================================================*/
+double benchmarkRenderer(SDL_Renderer *renderer, TTF_Font *font, int frames,
+                         int perspective, double *stage_ms) {
+  notearena chart;
+  static gamestate state;
+  Uint32 seen_effect = 0;
+  double totals[NUM_STAGES] = {0};
+  Uint64 start, last, now;
+
+  if (frames <= 0) return 0;
+  if (makeSyntheticChart(&chart, BENCH_NOTES)) return 0;
+
+  memset(&state, 0, sizeof(state));
+  state.parts[0].notes = chart;
+  state.num_parts = 1;
+  state.shown_parts = 1;
+  state.hud = bench_hud;
+  state.perspective = perspective;
+
+  // Logic and rendering back to back, the way the two threads would
+  start = last = SDL_GetPerformanceCounter();
+  for (int i=0; i<frames; i++) {
+    state.frame = i;
+    state.song_time = (int64_t)i*TIMELINE_RATE/60;
+    state.pitchindex = i%NUM_PITCHES;
+    scrollParts(&state);
+    judgeNotes(&state);
+    playEffects(&state, &seen_effect);
+    updateParticles(&particles, 1);
+    renderFrame(renderer, font, &state, stage_ms ? totals : NULL);
+    SDL_RenderPresent(renderer);
+    now = SDL_GetPerformanceCounter();
+    hudEndFrame((now - last)*1000.0/SDL_GetPerformanceFrequency());
+    last = now;
+  }
+
+  particles.count = 0;
+  freeNotes(&chart);
+  if (stage_ms) {
+    for (int s=0; s<NUM_STAGES; s++)
+      stage_ms[s] = totals[s]/frames;
+  }
+  return frames*(double)SDL_GetPerformanceFrequency()/(last - start);
+}
+
+
+/*===============< loadResources >================*
+ * Everything renderFrame draws with, created in  *
+ * renderer. Returns 0 on success.                *
+ *================================================*/
+static int loadResources(SDL_Renderer *renderer) {
+  bench_hud = (hudInit(renderer, FONT_PATH, 1) == 0);
+  digitsInit(&score_digits, renderer, FONT_PATH, SCORE_FONT_SIZE, NULL, 1);
+  initHighway();
+  if (atlasLoad(&game_atlas, renderer, 1)) {
+    printf("Error building sprite atlas: %s\n", SDL_GetError());
+    return 1;
+  }
+  return 0;
+}
+
+static void freeResources(void) {
+  hudQuit();
+  digitsFree(&score_digits);
+  clearTextCache();
+  atlasFree(&game_atlas);
+  batchFree(&sprites);
+  queueFree(&frame_queue);
+}
+
+
+/*==============< benchmarkDriver >===============*
+ * Frames per second of render driver index on    *
+ * window, running the game's real draw workload. *
+ * 0 if the driver won't start.                   *
+ *================================================*/
+double benchmarkDriver(SDL_Window *window, int index, int frames) {
+  SDL_Renderer *renderer;
+  TTF_Font *font;
+  double fps = 0;
+
+  // No vsync here, or every driver would tie at the refresh rate
+  renderer = SDL_CreateRenderer(window, index, 0);
+  if (renderer == NULL) return 0;
+
+  font = TTF_OpenFont(FONT_PATH, 72);
+  if (loadResources(renderer) == 0)
+    fps = benchmarkRenderer(renderer, font, frames, 0, NULL);
+
+  freeResources();
+  if (font) TTF_CloseFont(font);
+  SDL_DestroyRenderer(renderer);
+  return fps;
+}
+
+
+/*===============< runBenchmark >================*
+ * Set up an offscreen software renderer, run    *
+ * the benchmark and print the results.          *
+ *===============================================*/
+int runBenchmark(int frames) {
+  SDL_Surface *target;
+  SDL_Renderer *renderer;
+  TTF_Font *font;
+  double stage_ms[NUM_STAGES];
+  double fps = 0, total = 0;
+
+  // Software rendering into a surface needs no video or audio driver
+  if (SDL_Init(SDL_INIT_TIMER) < 0 || TTF_Init() < 0) {
+    printf("Error initializing SDL: %s\n", SDL_GetError());
+    return 1;
+  }
+
+  target = SDL_CreateRGBSurfaceWithFormat(0, WIDTH, HEIGHT, 32,
+                                          SDL_PIXELFORMAT_ARGB8888);
+  renderer = target ? SDL_CreateSoftwareRenderer(target) : NULL;
+  if (renderer == NULL) {
+    printf("Error creating software renderer: %s\n", SDL_GetError());
+    SDL_Quit();
+    return 1;
+  }
+
+  // Text is part of the workload, but CI boxes may not have the font
+  font = TTF_OpenFont(FONT_PATH, 72);
+  if (font == NULL)
+    printf("bench: %s not found, skipping text\n", FONT_PATH);
+
+  // Flat highway, then perspective
+  for (int view=0; view<2 && loadResources(renderer) == 0; view++) {
+    fps = benchmarkRenderer(renderer, font, frames, view, stage_ms);
+    freeResources();
+    if (fps <= 0) break;
+
+    printf("bench: %s, %d frames, %d notes, %.1f fps\n",
+           view ? "perspective" : "flat", frames, BENCH_NOTES, fps);
+    total = 0;
+    for (int s=0; s<NUM_STAGES; s++) {
+      printf("  %-9s %8.3f ms\n", stageNames[s], stage_ms[s]);
+      total += stage_ms[s];
+    }
+    printf("  %-9s %8.3f ms\n", "total", total);
+  }
+
+  // Cleanup
+  if (font) TTF_CloseFont(font);
+  SDL_DestroyRenderer(renderer);
+  SDL_FreeSurface(target);
+  SDL_Quit();
+  return fps > 0 ? 0 : 1;
+}
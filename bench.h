@@ -0,0 +1,17 @@
+/* Headless Render Benchmark */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#define BENCH_FRAMES 600    // Default number of frames to render
+#define BENCH_NOTES  4096   // Notes in the synthetic chart
+
+double benchmarkRenderer(SDL_Renderer *renderer, TTF_Font *font, int frames,
+                         int perspective, double *stage_ms);
+double benchmarkDriver(SDL_Window *window, int index, int frames);
+int runBenchmark(int frames);
+
+#endif
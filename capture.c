@@ -0,0 +1,265 @@
+/*=======================*
+ |     Video Capture     |
+ *=======================*/
+
+/* Records gameplay to a raw YUV4MPEG2 (.y4m) file for attract mode and
+ * tournament footage. The render thread reads each frame back into one
+ * of a few preallocated buffers and queues it; a writer thread converts
+ * to 4:2:0 and streams it to disk. If the writer falls behind, frames are
+ * dropped per the policy instead of making the game wait, and the writer
+ * repeats the previous frame over the gap so playback keeps real time.
+ *
+ *   ./theremin --capture out.y4m [--drop-oldest]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+#include "hud.h"
+
+
+/*==============< rgbaToYUV420 >===============*
+ * BT.601 full range (C420jpeg); chroma is the *
+ * average of each 2x2 block.                  *
+ *=============================================*/
+static void rgbaToYUV420(const Uint8 *rgba, Uint8 *yuv, int w, int h) {
+  Uint8 *yp = yuv, *up = yuv + w*h, *vp = up + (w/2)*(h/2);
+
+  for (int y=0; y<h; y++) {
+    const Uint8 *p = rgba + y*w*4;
+    for (int x=0; x<w; x++, p+=4)
+      yp[y*w + x] = (77*p[0] + 150*p[1] + 29*p[2]) >> 8;
+  }
+
+  for (int y=0; y<h; y+=2) {
+    for (int x=0; x<w; x+=2) {
+      const Uint8 *p0 = rgba + (y*w + x)*4, *p1 = p0 + w*4;
+      int r = p0[0] + p0[4] + p1[0] + p1[4];
+      int g = p0[1] + p0[5] + p1[1] + p1[5];
+      int b = p0[2] + p0[6] + p1[2] + p1[6];
+      *up++ = (Uint8)(128 + ((-43*r - 85*g + 128*b) >> 10));
+      *vp++ = (Uint8)(128 + ((128*r - 107*g - 21*b) >> 10));
+    }
+  }
+}
+
+
+/*===============< scaleFrame >================*
+ * Nearest-neighbour resample of an sw x sh    *
+ * RGBA picture to dw x dh.                    *
+ *=============================================*/
+static void scaleFrame(const Uint8 *src, int sw, int sh,
+                       Uint8 *dst, int dw, int dh) {
+  for (int y=0; y<dh; y++) {
+    const Uint32 *row = (const Uint32*)(src + (y*sh/dh)*sw*4);
+    Uint32 *out = (Uint32*)(dst + y*dw*4);
+    for (int x=0; x<dw; x++)
+      out[x] = row[x*sw/dw];
+  }
+}
+
+
+/*===============< playArea >================*
+ * The letterboxed play area in output       *
+ * pixels: the logical viewport, scaled.     *
+ *===========================================*/
+static SDL_Rect playArea(SDL_Renderer *renderer) {
+  SDL_Rect vp;
+  float sx, sy;
+
+  SDL_RenderGetViewport(renderer, &vp);
+  SDL_RenderGetScale(renderer, &sx, &sy);
+  return (SDL_Rect){(int)(vp.x*sx + 0.5f), (int)(vp.y*sy + 0.5f),
+                    (int)(vp.w*sx), (int)(vp.h*sy)};
+}
+
+
+static void writeFrame(capture *cap) {
+  fputs("FRAME\n", cap->file);
+  fwrite(cap->yuv, 1, cap->w*cap->h*3/2, cap->file);
+  cap->written++;
+}
+
+
+/*===============< writerLoop >================*
+ * Take queued frames, oldest first, and put   *
+ * them on disk. The lock is never held during *
+ * conversion or I/O.                          *
+ *=============================================*/
+static int writerLoop(void *data) {
+  capture *cap = data;
+  int idx;
+  uint64_t frame;
+
+  for (;;) {
+    SDL_LockMutex(cap->lock);
+    while (cap->queue_len == 0 && !cap->quit)
+      SDL_CondWait(cap->wake, cap->lock);
+    if (cap->queue_len == 0) {          // Quitting and drained
+      SDL_UnlockMutex(cap->lock);
+      break;
+    }
+    idx = cap->queue[cap->queue_head];
+    cap->queue_head = (cap->queue_head+1)%CAPTURE_BUFFERS;
+    cap->queue_len--;
+    frame = cap->frame_nums[idx];
+    SDL_UnlockMutex(cap->lock);
+
+    // Hold the previous picture over any frames we didn't get
+    if (cap->written > 0 && frame > cap->last_written+1) {
+      uint64_t gap = frame - cap->last_written - 1;
+      if (gap > CAPTURE_MAX_GAP) gap = CAPTURE_MAX_GAP;
+      for (uint64_t i=0; i<gap; i++)
+        writeFrame(cap);
+    }
+
+    rgbaToYUV420(cap->frames[idx], cap->yuv, cap->w, cap->h);
+
+    SDL_LockMutex(cap->lock);
+    cap->free_list[cap->num_free++] = idx;
+    SDL_UnlockMutex(cap->lock);
+
+    writeFrame(cap);
+    cap->last_written = frame;
+  }
+  return 0;
+}
+
+
+/*================< startCapture >=================*
+ * Open path, write the Y4M header, allocate every *
+ * buffer up front and start the writer. Returns 0 *
+ * on success.                                     *
+ *=================================================*/
+int startCapture(capture *cap, const char *path, int policy, int w, int h) {
+  memset(cap, 0, sizeof(*cap));
+  cap->w = w & ~1;
+  cap->h = h & ~1;
+  cap->policy = policy;
+
+  cap->file = fopen(path, "wb");
+  if (cap->file == NULL) {
+    printf("Error opening capture file %s\n", path);
+    return 1;
+  }
+  fprintf(cap->file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n",
+          cap->w, cap->h);
+
+  cap->yuv = malloc(cap->w*cap->h*3/2);
+  for (int i=0; i<CAPTURE_BUFFERS; i++) {
+    cap->frames[i] = malloc(cap->w*cap->h*4);
+    cap->free_list[cap->num_free++] = i;
+    if (cap->frames[i] == NULL) goto fail;
+  }
+  cap->lock = SDL_CreateMutex();
+  cap->wake = SDL_CreateCond();
+  if (cap->yuv == NULL || cap->lock == NULL || cap->wake == NULL) goto fail;
+
+  cap->thread = SDL_CreateThread(writerLoop, "capture", cap);
+  if (cap->thread == NULL) goto fail;
+  return 0;
+
+fail:
+  printf("Error starting capture: %s\n", SDL_GetError());
+  stopCapture(cap);
+  return 1;
+}
+
+
+/*================< captureFrame >=================*
+ * Read back what's been rendered (call before     *
+ * SDL_RenderPresent) and queue it for the writer. *
+ * The play area is scaled to the file's size if   *
+ * the window has been resized since the start.    *
+ *=================================================*/
+void captureFrame(capture *cap, SDL_Renderer *renderer, uint64_t frame) {
+  Uint64 start = SDL_GetPerformanceCounter();
+  SDL_Rect area = playArea(renderer);
+  int idx = -1;
+
+  if (cap->thread == NULL) return;
+
+  SDL_LockMutex(cap->lock);
+  if (cap->num_free > 0) {
+    idx = cap->free_list[--cap->num_free];
+  }
+  else if (cap->policy == CAPTURE_DROP_OLDEST && cap->queue_len > 0) {
+    // Steal the oldest queued frame back from the writer
+    idx = cap->queue[cap->queue_head];
+    cap->queue_head = (cap->queue_head+1)%CAPTURE_BUFFERS;
+    cap->queue_len--;
+    cap->dropped++;
+  }
+  else {
+    cap->dropped++;
+  }
+  SDL_UnlockMutex(cap->lock);
+
+  if (idx >= 0) {
+    int got = 0;
+    if (area.w == cap->w && area.h == cap->h) {
+      SDL_RenderReadPixels(renderer, &area, SDL_PIXELFORMAT_RGBA32,
+                           cap->frames[idx], cap->w*4);
+      got = 1;
+    }
+    else if (area.w > 0 && area.h > 0) {
+      if (area.w*area.h*4 > cap->readback_size) {
+        Uint8 *grown = realloc(cap->readback, area.w*area.h*4);
+        if (grown) {
+          cap->readback = grown;
+          cap->readback_size = area.w*area.h*4;
+        }
+      }
+      if (area.w*area.h*4 <= cap->readback_size) {
+        SDL_RenderReadPixels(renderer, &area, SDL_PIXELFORMAT_RGBA32,
+                             cap->readback, area.w*4);
+        scaleFrame(cap->readback, area.w, area.h,
+                   cap->frames[idx], cap->w, cap->h);
+        got = 1;
+      }
+    }
+
+    SDL_LockMutex(cap->lock);
+    if (got) {
+      cap->frame_nums[idx] = frame;
+      cap->queue[(cap->queue_head + cap->queue_len)%CAPTURE_BUFFERS] = idx;
+      cap->queue_len++;
+      SDL_CondSignal(cap->wake);
+    }
+    else {
+      // Nothing read into it: queueing it would repeat a stale picture
+      cap->free_list[cap->num_free++] = idx;
+      cap->dropped++;
+    }
+    SDL_UnlockMutex(cap->lock);
+  }
+
+  perf.capture_ms =
+    (SDL_GetPerformanceCounter() - start)*1000.0/SDL_GetPerformanceFrequency();
+  perf.capture_drops = cap->dropped;
+}
+
+
+/*=================< stopCapture >==================*
+ * Let the writer drain the queue, then close up.   *
+ *==================================================*/
+void stopCapture(capture *cap) {
+  if (cap->thread) {
+    SDL_LockMutex(cap->lock);
+    cap->quit = 1;
+    SDL_CondSignal(cap->wake);
+    SDL_UnlockMutex(cap->lock);
+    SDL_WaitThread(cap->thread, NULL);
+    printf("capture: %d frames written, %d dropped\n",
+           cap->written, cap->dropped);
+  }
+  if (cap->file) fclose(cap->file);
+  if (cap->wake) SDL_DestroyCond(cap->wake);
+  if (cap->lock) SDL_DestroyMutex(cap->lock);
+  for (int i=0; i<CAPTURE_BUFFERS; i++)
+    free(cap->frames[i]);
+  free(cap->yuv);
+  free(cap->readback);
+  memset(cap, 0, sizeof(*cap));
+}
@@ -0,0 +1,51 @@
+/* Gameplay Video Capture */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <SDL2/SDL.h>
+
+#define CAPTURE_BUFFERS 8       // Frames in flight between game and disk
+#define CAPTURE_MAX_GAP 60      // Most frames we'll repeat to cover a gap
+
+/* What to give up when every buffer is still waiting for the disk */
+enum {
+  CAPTURE_DROP_NEWEST,          // Skip the frame being captured
+  CAPTURE_DROP_OLDEST           // Recycle the oldest frame not yet written
+};
+
+typedef struct {
+  FILE *file;
+  int w, h;                     // Even, as 4:2:0 needs; fixed for the file
+  int policy;
+
+  // Frame pool; everything below lock is guarded by it
+  Uint8 *frames[CAPTURE_BUFFERS];       // RGBA, w*h*4 each
+  uint64_t frame_nums[CAPTURE_BUFFERS]; // Game frame each one shows
+  SDL_mutex *lock;
+  SDL_cond *wake;
+  int free_list[CAPTURE_BUFFERS];
+  int num_free;
+  int queue[CAPTURE_BUFFERS];           // Filled, oldest first
+  int queue_head;
+  int queue_len;
+  int quit;
+  int dropped;
+
+  // Render thread only: the play area when it isn't w x h, before scaling
+  Uint8 *readback;
+  int readback_size;
+
+  // Writer thread only
+  SDL_Thread *thread;
+  Uint8 *yuv;                   // Last converted frame, reused for gaps
+  uint64_t last_written;
+  int written;
+} capture;
+
+int startCapture(capture *cap, const char *path, int policy, int w, int h);
+void captureFrame(capture *cap, SDL_Renderer *renderer, uint64_t frame);
+void stopCapture(capture *cap);
+
+#endif
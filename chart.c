@@ -0,0 +1,686 @@
+/*=======================*
+ |     Chart Loading     |
+ *=======================*/
+
+/* Reads .tmn charts (see songs/musicspec.txt):
+ *
+ *   line 1     MP3 file name (may be empty)
+ *   line 2     start offset into the MP3 (may be empty)
+ *   line 3...  pitch index, duration
+ *              or bpm N: later durations are beats at N BPM
+ *              or part NAME: later notes are another part's
+ *
+ * Durations are 60 Hz frames until the first bpm line. Loading sums them
+ * into an absolute timeline in TIMELINE_RATE samples, rounding each note's
+ * start and end on their own so long songs don't drift.
+ *
+ * A chart holds up to MAX_PARTS parts (lead, harmony, bass...). Each part
+ * starts over at time 0 in frames, like the top of the file. Notes before
+ * the first part line are the lead's. The parts lie one after another in
+ * the chart's one block of notes, and each is a notearena over its stretch.
+ *
+ * The file is mmapped and parsed where it lies: one pass counts lines
+ * to size the note array, a second reads numbers digit by digit. No
+ * stdio, no sscanf, no allocation per line. The notes go into a
+ * notearena, so a song is one block, freed with one call.
+ *
+ * Errors are printed as path:line:col: message, like a compiler's.
+ *
+ * Charts that don't change can be compiled ahead of time (make tmnc) to
+ * .tmnb: a fixed header, a table of parts, and a table of fixed-width
+ * little-endian note records with each note's start and end samples
+ * worked out. Loading one is checking the header and copying the tables
+ * out into columns.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chart.h"
+#include "game.h"
+
+typedef struct {
+  const char *p, *end;
+  const char *line_start;
+  int line;
+  const char *path;
+} cursor;
+
+
+static void parseError(const cursor *c, const char *msg) {
+  printf("%s:%d:%d: %s\n", c->path, c->line, (int)(c->p - c->line_start) + 1,
+         msg);
+}
+
+static void skipBlanks(cursor *c) {
+  while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\r'))
+    c->p++;
+}
+
+static int atLineEnd(const cursor *c) {
+  return c->p == c->end || *c->p == '\n';
+}
+
+/* word at the cursor, followed by a blank or the end of the line? */
+static int atKeyword(const cursor *c, const char *word) {
+  size_t len = strlen(word);
+  const char *after = c->p + len;
+
+  if ((size_t)(c->end - c->p) < len || memcmp(c->p, word, len) != 0)
+    return 0;
+  return after == c->end || *after == ' ' || *after == '\t' ||
+         *after == '\r' || *after == '\n';
+}
+
+static void nextLine(cursor *c) {
+  while (c->p < c->end && *c->p != '\n') c->p++;
+  if (c->p < c->end) c->p++;
+  c->line_start = c->p;
+  c->line++;
+}
+
+
+/*============< parseNumber >=============*
+ * Unsigned decimal (optional fraction)   *
+ * at the cursor. Returns 0 on success.   *
+ *========================================*/
+static int parseNumber(cursor *c, double *value, int whole_only) {
+  double v = 0, scale = 1;
+  int digits = 0;
+
+  while (c->p < c->end && *c->p >= '0' && *c->p <= '9') {
+    v = v*10 + (*c->p++ - '0');
+    digits++;
+  }
+  if (!whole_only && c->p < c->end && *c->p == '.') {
+    c->p++;
+    while (c->p < c->end && *c->p >= '0' && *c->p <= '9') {
+      scale *= 0.1;
+      v += (*c->p++ - '0')*scale;
+      digits++;
+    }
+  }
+  if (digits == 0) {
+    parseError(c, whole_only ? "expected a whole number"
+                             : "expected a number");
+    return 1;
+  }
+  *value = v;
+  return 0;
+}
+
+
+/*==============< parseTempo >===============*
+ * The rest of a "bpm N" line, cursor on the *
+ * "bpm". Sets *per_unit to samples per beat *
+ * at N BPM. Returns 0 on success.           *
+ *===========================================*/
+static int parseTempo(cursor *cur, double *per_unit) {
+  const char *start;
+  double bpm;
+
+  if (cur->end - cur->p < 3 || memcmp(cur->p, "bpm", 3) != 0) {
+    parseError(cur, "expected a pitch index, bpm or part");
+    return 1;
+  }
+  cur->p += 3;
+  skipBlanks(cur);
+  start = cur->p;
+  if (parseNumber(cur, &bpm, 0)) return 1;
+  if (bpm <= 0) {
+    cur->p = start;
+    parseError(cur, "bpm must be more than 0");
+    return 1;
+  }
+  skipBlanks(cur);
+  if (!atLineEnd(cur)) {
+    parseError(cur, "unexpected text after bpm");
+    return 1;
+  }
+  *per_unit = TIMELINE_RATE*60.0/bpm;
+  if (!isfinite(*per_unit) || *per_unit <= 0) {
+    cur->p = start;
+    parseError(cur, "bpm out of range");
+    return 1;
+  }
+  return 0;
+}
+
+
+/*===============< parsePart >================*
+ * The rest of a "part NAME" line, cursor on   *
+ * the "part". Copies the name, without blanks *
+ * around it, to name. Returns 0 on success.   *
+ *=============================================*/
+static int parsePart(cursor *cur, const chart *c, char *name) {
+  const char *start;
+  size_t len;
+
+  cur->p += 4;
+  skipBlanks(cur);
+  start = cur->p;
+  while (!atLineEnd(cur)) cur->p++;
+  len = cur->p - start;
+  while (len > 0 && (start[len-1] == ' ' || start[len-1] == '\t' ||
+                     start[len-1] == '\r'))
+    len--;
+
+  cur->p = start;
+  if (len == 0) {
+    parseError(cur, "expected a part name");
+    return 1;
+  }
+  if (len >= PART_NAME_LEN) {
+    parseError(cur, "part name too long");
+    return 1;
+  }
+  memcpy(name, start, len);
+  name[len] = '\0';
+  if (findPart(c, name) >= 0) {
+    parseError(cur, "part already defined");
+    return 1;
+  }
+  if (c->num_parts == MAX_PARTS) {
+    parseError(cur, "too many parts");
+    return 1;
+  }
+  return 0;
+}
+
+
+/*=============< parseNotes >==============*
+ * Every "pitch, duration", "bpm" and      *
+ * "part" line from the cursor on into c,  *
+ * timed. Returns 0 on success.            *
+ *=========================================*/
+static int parseNotes(cursor *cur, chart *c) {
+  notearena *n = &c->notes;
+  char name[PART_NAME_LEN] = DEFAULT_PART;  // Part being read
+  int first = 0;                          // Its first note
+  int named = 0;                          // Seen a part line yet?
+  double per_unit = TIMELINE_RATE/60.0;   // Samples per duration unit
+  double t = 0;                           // Where the next note starts
+
+  while (cur->p < cur->end) {
+    const char *start;
+    double pitch, duration;
+
+    skipBlanks(cur);
+    if (atLineEnd(cur)) {             // Blank lines are fine
+      nextLine(cur);
+      continue;
+    }
+    if (atKeyword(cur, "part")) {
+      // The lead only counts if it has notes before the first part line
+      if (named || n->count > 0)
+        addPart(c, name, first, n->count - first);
+      if (parsePart(cur, c, name)) return 1;
+      first = n->count;
+      named = 1;
+      per_unit = TIMELINE_RATE/60.0;  // Every part starts from the top
+      t = 0;
+      nextLine(cur);
+      continue;
+    }
+    if (*cur->p < '0' || *cur->p > '9') {
+      if (parseTempo(cur, &per_unit)) return 1;
+      nextLine(cur);
+      continue;
+    }
+
+    start = cur->p;
+    if (parseNumber(cur, &pitch, 1)) return 1;
+    if (pitch >= NUM_PITCHES) {
+      cur->p = start;                 // Point at the number, not past it
+      parseError(cur, "pitch index out of range");
+      return 1;
+    }
+    skipBlanks(cur);
+    if (cur->p == cur->end || *cur->p != ',') {
+      parseError(cur, "expected ',' after pitch index");
+      return 1;
+    }
+    cur->p++;
+    skipBlanks(cur);
+    start = cur->p;
+    if (parseNumber(cur, &duration, 0)) return 1;
+    if (duration <= 0) {
+      cur->p = start;
+      parseError(cur, "duration must be more than 0");
+      return 1;
+    }
+    skipBlanks(cur);
+    if (!atLineEnd(cur)) {
+      parseError(cur, "unexpected text after duration");
+      return 1;
+    }
+
+    n->pitch[n->count] = (uint8_t)pitch;
+    n->start[n->count] = llround(t);
+    t += duration*per_unit;
+    // Past what a sample count holds, end would wrap to before start
+    if (!isfinite(t) || t >= (double)INT64_MAX) {
+      cur->p = start;
+      parseError(cur, "note ends too late");
+      return 1;
+    }
+    n->end[n->count] = llround(t);
+    if (n->end[n->count] <= n->start[n->count]) {
+      cur->p = start;
+      parseError(cur, "duration too short to hear");
+      return 1;
+    }
+    n->count++;
+    nextLine(cur);
+  }
+  addPart(c, name, first, n->count - first);
+  markSustains(n);
+  return 0;
+}
+
+
+/*============< mapFile >=============*
+ * Read-only mapping of path. *size 0 *
+ * maps nothing. Returns NULL (after  *
+ * saying why) on failure.            *
+ *====================================*/
+static const char *mapFile(const char *path, size_t *size) {
+  static const char empty[1];
+  struct stat st;
+  void *map;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    printf("Error opening chart %s\n", path);
+    if (fd >= 0) close(fd);
+    return NULL;
+  }
+  *size = st.st_size;
+  if (*size == 0) {
+    close(fd);
+    return empty;
+  }
+  map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    printf("Error mapping chart %s\n", path);
+    return NULL;
+  }
+  return map;
+}
+
+static void unmapFile(const char *text, size_t size) {
+  if (size) munmap((void*)text, size);
+}
+
+
+/*=============< markSustains >==============*
+ * Flag the notes whose trail shows: the ones *
+ * that last longer than their head is tall.  *
+ *============================================*/
+void markSustains(notearena *n) {
+  for (int i=0; i<n->count; i++)
+    n->flags[i] = (SCROLL_PIXELS(n->end[i] - n->start[i]) > NOTE_HEIGHT)
+                  ? NOTE_SUSTAIN : 0;
+}
+
+
+/*===============< loadText >================*
+ * Parse a mapped .tmn. Returns 0 on success *
+ *===========================================*/
+static int loadText(chart *c, const char *path, const char *text,
+                    size_t size) {
+  cursor cur = {0};
+  const char *name;
+  size_t len, max_notes = 1;
+
+  // Every note needs its own line, so this many is always enough
+  for (size_t i=0; i<size; i++)
+    max_notes += (text[i] == '\n');
+  if (max_notes > INT_MAX || allocNotes(&c->notes, (int)max_notes)) {
+    printf("Out of memory loading %s\n", path);
+    return 1;
+  }
+
+  cur.p = cur.line_start = text;
+  cur.end = text + size;
+  cur.line = 1;
+  cur.path = path;
+
+  // Line 1: MP3 name, copied without the line ending
+  name = cur.p;
+  nextLine(&cur);
+  len = cur.p - name;
+  while (len > 0 && (name[len-1] == '\n' || name[len-1] == '\r')) len--;
+  if (len >= CHART_MP3_LEN) {
+    cur.line--;
+    cur.p = cur.line_start = name;
+    parseError(&cur, "MP3 name too long");
+    return 1;
+  }
+  memcpy(c->mp3, name, len);
+  c->mp3[len] = '\0';
+
+  // Line 2: start offset, blank meaning 0
+  skipBlanks(&cur);
+  if (!atLineEnd(&cur)) {
+    const char *start = cur.p;
+    if (parseNumber(&cur, &c->offset, 0)) return 1;
+    if (!isfinite(c->offset)) {
+      cur.p = start;
+      parseError(&cur, "offset out of range");
+      return 1;
+    }
+    skipBlanks(&cur);
+    if (!atLineEnd(&cur)) {
+      parseError(&cur, "unexpected text after offset");
+      return 1;
+    }
+  }
+  nextLine(&cur);
+
+  return parseNotes(&cur, c);
+}
+
+
+/*===============< loadBinary >================*
+ * Check a mapped .tmnb and take its notes.    *
+ * Returns 0 on success.                       *
+ *=============================================*/
+static int loadBinary(chart *c, const char *path, const char *data,
+                      size_t size) {
+  const tmnbheader *h = (const tmnbheader*)data;
+  const tmnbpart *parts = (const tmnbpart*)(data + sizeof(tmnbheader));
+  const tmnbnote *records;
+  uint32_t first = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  printf("%s: .tmnb is little-endian only\n", path);
+  return 1;
+#endif
+  if (size < sizeof(tmnbheader) || memcmp(h->magic, TMNB_MAGIC, 4) != 0) {
+    printf("%s: not a .tmnb chart\n", path);
+    return 1;
+  }
+  if (h->version != TMNB_VERSION || h->record_size != sizeof(tmnbnote)) {
+    printf("%s: .tmnb version %u, expected %d (recompile with make tmnc)\n",
+           path, h->version, TMNB_VERSION);
+    return 1;
+  }
+  if (h->num_parts < 1 || h->num_parts > MAX_PARTS ||
+      size < sizeof(tmnbheader) + h->num_parts*sizeof(tmnbpart) ||
+      (size - sizeof(tmnbheader) - h->num_parts*sizeof(tmnbpart))/
+        sizeof(tmnbnote) < h->num_notes ||
+      memchr(h->mp3, '\0', CHART_MP3_LEN) == NULL) {
+    printf("%s: truncated or corrupt\n", path);
+    return 1;
+  }
+  if (h->num_notes > INT_MAX || allocNotes(&c->notes, h->num_notes)) {
+    printf("Out of memory loading %s\n", path);
+    return 1;
+  }
+  records = (const tmnbnote*)(parts + h->num_parts);
+
+  memcpy(c->mp3, h->mp3, CHART_MP3_LEN);
+  c->offset = h->offset;
+  for (uint32_t p=0; p<h->num_parts; p++) {
+    // Parts cover the notes in order, with nothing left over
+    if (parts[p].first != first || parts[p].count > h->num_notes - first ||
+        memchr(parts[p].name, '\0', PART_NAME_LEN) == NULL ||
+        addPart(c, parts[p].name, first, parts[p].count)) {
+      printf("%s: part %u: corrupt\n", path, p);
+      return 1;
+    }
+    for (uint32_t i=first; i<first + parts[p].count; i++) {
+      if (records[i].pitch >= NUM_PITCHES) {
+        printf("%s: note %u: pitch index out of range\n", path, i);
+        return 1;
+      }
+      if (records[i].end < records[i].start ||
+          (i > first && records[i].start < records[i-1].end)) {
+        printf("%s: note %u: out of order\n", path, i);
+        return 1;
+      }
+      c->notes.start[i] = records[i].start;
+      c->notes.end[i] = records[i].end;
+      c->notes.pitch[i] = records[i].pitch;
+    }
+    first += parts[p].count;
+  }
+  if (first != h->num_notes) {
+    printf("%s: notes outside any part\n", path);
+    return 1;
+  }
+  c->notes.count = h->num_notes;
+  markSustains(&c->notes);
+  return 0;
+}
+
+
+/*================< loadChart >=================*
+ * Read the chart at path into c. With          *
+ * prefer_compiled, a .tmn whose .tmnb (from    *
+ * make tmnc) is there and at least as new is   *
+ * read from the .tmnb instead. Returns 0 on    *
+ * success; on failure prints where and why,    *
+ * and c is left empty.                         *
+ *==============================================*/
+int loadChart(chart *c, const char *path, int prefer_compiled) {
+  char compiled[1024];
+  struct stat text_st, bin_st;
+  const char *data;
+  size_t size, len = strlen(path);
+  const char *path_text = path;
+  int binary = 0, status;
+
+  memset(c, 0, sizeof(*c));
+  if (len >= 5 && strcmp(path + len - 5, ".tmnb") == 0) {
+    binary = 1;
+  }
+  else if (prefer_compiled && len >= 4 &&
+           strcmp(path + len - 4, ".tmn") == 0 &&
+           snprintf(compiled, sizeof(compiled), "%sb", path) <
+             (int)sizeof(compiled) &&
+           stat(compiled, &bin_st) == 0 &&
+           (stat(path, &text_st) != 0 || bin_st.st_mtime >= text_st.st_mtime)) {
+    path = compiled;
+    binary = 1;
+  }
+
+  data = mapFile(path, &size);
+  if (data == NULL) return 1;
+  status = binary ? loadBinary(c, path, data, size)
+                  : loadText(c, path, data, size);
+  unmapFile(data, size);
+  if (status) freeChart(c);
+
+  // A compiled chart we can't use: the text one is still there
+  if (status && path == compiled)
+    return loadChart(c, path_text, 0);
+  return status;
+}
+
+
+/*=============< checkTimeline >==============*
+ * Would loadBinary take c's notes? Each must *
+ * end after it starts, and not before the    *
+ * one ahead of it in its part ends.          *
+ *============================================*/
+static int checkTimeline(const chart *c, const char *path) {
+  for (int p=0; p<c->num_parts; p++) {
+    const notearena *n = &c->parts[p].notes;
+    for (int i=0; i<n->count; i++) {
+      if (n->pitch[i] >= NUM_PITCHES || n->end[i] <= n->start[i] ||
+          (i > 0 && n->start[i] < n->end[i-1])) {
+        printf("Not writing %s: part %s, note %d is out of order\n",
+               path, c->parts[p].name, i);
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+
+/*=============< saveChartBinary >==============*
+ * Write c as a .tmnb, timeline and all. A      *
+ * chart the loader would reject isn't written. *
+ * Returns 0 on success.                        *
+ *==============================================*/
+int saveChartBinary(const chart *c, const char *path) {
+  tmnbheader h;
+  tmnbpart p;
+  tmnbnote r;
+  FILE *f;
+  uint32_t first = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  printf("%s: .tmnb can only be written on little-endian machines\n", path);
+  return 1;
+#endif
+  if (checkTimeline(c, path)) return 1;
+  f = fopen(path, "wb");
+  if (f == NULL) {
+    printf("Error opening %s for writing\n", path);
+    return 1;
+  }
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, TMNB_MAGIC, 4);
+  h.version = TMNB_VERSION;
+  h.num_notes = c->notes.count;
+  h.record_size = sizeof(tmnbnote);
+  h.num_parts = c->num_parts;
+  h.offset = c->offset;
+  memcpy(h.mp3, c->mp3, CHART_MP3_LEN);
+  fwrite(&h, sizeof(h), 1, f);
+
+  for (int i=0; i<c->num_parts; i++) {
+    memset(&p, 0, sizeof(p));
+    memcpy(p.name, c->parts[i].name, PART_NAME_LEN);
+    p.first = first;
+    p.count = c->parts[i].notes.count;
+    first += p.count;
+    fwrite(&p, sizeof(p), 1, f);
+  }
+
+  for (int i=0; i<c->notes.count; i++) {
+    memset(&r, 0, sizeof(r));
+    r.start = c->notes.start[i];
+    r.end = c->notes.end[i];
+    r.pitch = c->notes.pitch[i];
+    fwrite(&r, sizeof(r), 1, f);
+  }
+
+  if (ferror(f) | fclose(f)) {
+    printf("Error writing %s\n", path);
+    return 1;
+  }
+  return 0;
+}
+
+
+/*==============< saveChartText >===============*
+ * Write c as a .tmn, with durations in frames  *
+ * precise enough to load back to the same      *
+ * samples. Gaps between notes can't be written *
+ * and go to the note before. A lone lead part  *
+ * needs no part line. Returns 0 on success.    *
+ *==============================================*/
+int saveChartText(const chart *c, const char *path) {
+  int named = (c->num_parts > 1 ||
+               (c->num_parts == 1 && strcmp(c->parts[0].name, DEFAULT_PART)));
+  FILE *f = fopen(path, "w");
+
+  if (f == NULL) {
+    printf("Error opening %s for writing\n", path);
+    return 1;
+  }
+  fprintf(f, "%s\n", c->mp3);
+  if (c->offset != 0)
+    fprintf(f, "%.10g", c->offset);
+  fprintf(f, "\n");
+  for (int p=0; p<c->num_parts; p++) {
+    const notearena *n = &c->parts[p].notes;
+    if (named)
+      fprintf(f, "part %s\n", c->parts[p].name);
+    for (int i=0; i<n->count; i++) {
+      int64_t end = (i+1 < n->count) ? n->start[i+1] : n->end[i];
+      fprintf(f, "%d,%.12g\n", n->pitch[i],
+              (end - n->start[i])*60.0/TIMELINE_RATE);
+    }
+  }
+
+  if (ferror(f) | fclose(f)) {
+    printf("Error writing %s\n", path);
+    return 1;
+  }
+  return 0;
+}
+
+
+/*==============< replaceExtension >===============*
+ * Copy path to out with its extension (if any)    *
+ * swapped for ext. Only the file name is looked   *
+ * at when keep_dir is 0.                          *
+ *=================================================*/
+void replaceExtension(char *out, size_t len, const char *path,
+                      const char *ext, int keep_dir) {
+  const char *name = strrchr(path, '/');
+  const char *dot;
+  int stem;
+
+  name = (name && !keep_dir) ? name + 1 : path;
+  dot = strrchr(name, '.');
+  if (dot && strchr(dot, '/')) dot = NULL;
+  stem = dot ? (int)(dot - name) : (int)strlen(name);
+  snprintf(out, len, "%.*s%s", stem, name, ext);
+}
+
+
+/*=================< addPart >==================*
+ * Make count notes of c, from note first on, a *
+ * part called name. Returns 0 on success, 1 if *
+ * c already has MAX_PARTS parts or one with    *
+ * that name.                                   *
+ *==============================================*/
+int addPart(chart *c, const char *name, int first, int count) {
+  chartpart *p;
+
+  if (c->num_parts == MAX_PARTS || findPart(c, name) >= 0)
+    return 1;
+  p = &c->parts[c->num_parts++];
+  snprintf(p->name, PART_NAME_LEN, "%s", name);
+  p->notes.start = c->notes.start + first;
+  p->notes.end = c->notes.end + first;
+  p->notes.pitch = c->notes.pitch + first;
+  p->notes.flags = c->notes.flags + first;
+  p->notes.count = count;
+  p->notes.block = NULL;      // The chart's block holds it
+  return 0;
+}
+
+/* Index of the part called name, or -1 */
+int findPart(const chart *c, const char *name) {
+  for (int i=0; i<c->num_parts; i++)
+    if (strcmp(c->parts[i].name, name) == 0)
+      return i;
+  return -1;
+}
+
+
+/*===========< freeChart >============*
+ * Everything loadChart allocated.    *
+ *====================================*/
+void freeChart(chart *c) {
+  freeNotes(&c->notes);
+  memset(c, 0, sizeof(*c));
+}
@@ -0,0 +1,70 @@
+/* Chart Loading */
+
+#ifndef CHART_H
+#define CHART_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "theremin.h"
+
+#define CHART_MP3_LEN 256
+#define TMNB_MAGIC    "TMNB"
+#define TMNB_VERSION  3
+#define PART_NAME_LEN 32
+#define DEFAULT_PART  "lead"      // Notes before any part line
+
+/* One line of the song, with a timeline of its own. Its columns point
+ * into the chart's notes, so it can be drawn, judged and searched like a
+ * whole chart, but isn't freed on its own. */
+typedef struct {
+  char name[PART_NAME_LEN];
+  notearena notes;
+} chartpart;
+
+typedef struct {
+  char mp3[CHART_MP3_LEN];    // Line 1: audio file to play along with
+  double offset;              // Line 2: where in the MP3 the chart starts
+  notearena notes;            // Every part's notes, one part after another
+  chartpart parts[MAX_PARTS];
+  int num_parts;
+} chart;
+
+/* .tmnb: this header, num_parts part records, then num_notes note
+ * records, all little-endian */
+typedef struct {
+  char magic[4];              // TMNB_MAGIC
+  uint32_t version;           // TMNB_VERSION
+  uint32_t num_notes;
+  uint32_t record_size;       // sizeof(tmnbnote)
+  uint32_t num_parts;
+  uint32_t reserved;
+  double offset;
+  char mp3[CHART_MP3_LEN];    // NUL-terminated
+} tmnbheader;
+
+typedef struct {
+  char name[PART_NAME_LEN];   // NUL-terminated
+  uint32_t first;             // Index of its first note record
+  uint32_t count;
+} tmnbpart;
+
+typedef struct {
+  int64_t start;              // Sample the note reaches the hit line
+  int64_t end;                // Sample it's over
+  uint8_t pitch;
+  uint8_t flags;              // None stored yet; written as 0
+  uint8_t reserved[6];
+} tmnbnote;
+
+int loadChart(chart *c, const char *path, int prefer_compiled);
+int saveChartBinary(const chart *c, const char *path);
+int saveChartText(const chart *c, const char *path);
+void replaceExtension(char *out, size_t len, const char *path,
+                      const char *ext, int keep_dir);
+int addPart(chart *c, const char *name, int first, int count);
+int findPart(const chart *c, const char *name);
+void freeChart(chart *c);
+void markSustains(notearena *n);
+
+#endif
@@ -0,0 +1,362 @@
+/*=======================*
+ |    Chart Generator    |
+ *=======================*/
+
+/* Charts a song from its audio. The melody's pitch is tracked once per
+ * frame with YIN, moved by octaves into the lanes and snapped to the
+ * nearest one, then runs of the same lane become notes:
+ *
+ *   ./chartgen [-b] song.wav [out]
+ *
+ * The audio is anything SDL_LoadWAV reads, mixed down to mono at
+ * TIMELINE_RATE. MP3s need decoding to WAV first; the chart still names
+ * the MP3, so song.wav charts song.mp3. -b writes .tmnb instead of .tmn.
+ *
+ * Every frame's window is independent, so frames are handed out in
+ * blocks to a thread per core.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <SDL2/SDL.h>
+
+#include "chart.h"
+#include "game.h"
+
+#define HOP (TIMELINE_RATE/60)        // One pitch per frame
+#define YIN_WINDOW 1024               // Samples compared per lag
+#define MIN_LAG (TIMELINE_RATE/1000)  // Highest pitch tracked: 1 kHz
+#define MAX_LAG (TIMELINE_RATE/80)    // Lowest: 80 Hz
+#define YIN_THRESHOLD 0.15            // Dips below this are periodic
+#define SILENCE_RMS 0.01              // About -40 dB: nothing playing
+#define SMOOTH_FRAMES 5               // Lanes are voted on this many frames
+#define MIN_NOTE_FRAMES 6             // Shorter runs join the note before
+#define FRAME_BLOCK 64                // Frames a thread takes at a time
+#define UNVOICED -1
+
+/* Frames left to analyse, shared by the analysis threads */
+typedef struct {
+  const float *samples;
+  int8_t *lanes;                      // Per frame: lane, or UNVOICED
+  int num_frames;
+  SDL_atomic_t next;                  // First frame of the next block
+} pitchjob;
+
+/* A run of frames in one lane */
+typedef struct {
+  int lane;
+  int start, end;
+} segment;
+
+
+/*=============< loadAudio >==============*
+ * Read the WAV at path as mono floats at *
+ * TIMELINE_RATE into *samples. Returns   *
+ * how many, or -1 on failure.            *
+ *========================================*/
+static long loadAudio(const char *path, float **samples) {
+  SDL_AudioSpec spec;
+  SDL_AudioCVT cvt;
+  Uint8 *buf;
+  Uint32 len;
+
+  if (SDL_LoadWAV(path, &spec, &buf, &len) == NULL) {
+    printf("Error loading %s: %s\n", path, SDL_GetError());
+    return -1;
+  }
+  if (SDL_BuildAudioCVT(&cvt, spec.format, spec.channels, spec.freq,
+                        AUDIO_F32SYS, 1, TIMELINE_RATE) < 0) {
+    printf("Can't convert %s: %s\n", path, SDL_GetError());
+    SDL_FreeWAV(buf);
+    return -1;
+  }
+
+  cvt.len = len;
+  cvt.buf = malloc((size_t)len*cvt.len_mult);
+  if (cvt.buf == NULL) {
+    printf("Out of memory loading %s\n", path);
+    SDL_FreeWAV(buf);
+    return -1;
+  }
+  memcpy(cvt.buf, buf, len);
+  SDL_FreeWAV(buf);
+  if (SDL_ConvertAudio(&cvt)) {
+    printf("Can't convert %s: %s\n", path, SDL_GetError());
+    free(cvt.buf);
+    return -1;
+  }
+
+  *samples = (float*)cvt.buf;
+  return cvt.len_cvt/sizeof(float);
+}
+
+
+/*=============< nearestLane >==============*
+ * Move f by octaves into the lanes' range  *
+ * and return the lane closest in pitch.    *
+ *==========================================*/
+static int nearestLane(double f) {
+  double low = pitches[0]/pow(2, 1/24.0);
+  double high = pitches[NUM_PITCHES-1]*pow(2, 1/24.0);
+  double best = INFINITY;
+  int lane = 0;
+
+  while (f < low) f *= 2;
+  while (f > high) f /= 2;
+  for (int i=0; i<NUM_PITCHES; i++) {
+    double off = fabs(log(f/pitches[i]));
+    if (off < best) {
+      best = off;
+      lane = i;
+    }
+  }
+  return lane;
+}
+
+
+/*===============< yinLane >================*
+ * Track the pitch of the window starting   *
+ * at x (YIN_WINDOW + MAX_LAG samples) and  *
+ * return its lane, or UNVOICED if it's     *
+ * quiet or has no clear pitch.             *
+ *==========================================*/
+static int yinLane(const float *x) {
+  float diff[MAX_LAG+1];
+  double sum = 0, energy = 0;
+  int tau;
+
+  for (int j=0; j<YIN_WINDOW; j++)
+    energy += x[j]*x[j];
+  if (energy < SILENCE_RMS*SILENCE_RMS*YIN_WINDOW)
+    return UNVOICED;
+
+  // Difference function, then normalized by its running mean
+  diff[0] = 1;
+  for (tau=1; tau<=MAX_LAG; tau++) {
+    float d = 0;
+    for (int j=0; j<YIN_WINDOW; j++) {
+      float delta = x[j] - x[j+tau];
+      d += delta*delta;
+    }
+    sum += d;
+    diff[tau] = sum > 0 ? d*tau/sum : 1;
+  }
+
+  // First dip under the threshold, followed down to its bottom
+  for (tau=MIN_LAG; tau<MAX_LAG; tau++) {
+    if (diff[tau] < YIN_THRESHOLD) {
+      double shift = 0, a, b, c;
+      while (tau+1 < MAX_LAG && diff[tau+1] < diff[tau]) tau++;
+
+      // Parabola through the bottom three for a lag between samples
+      a = diff[tau-1], b = diff[tau], c = diff[tau+1];
+      if (a + c - 2*b > 0) shift = (a - c)/(2*(a + c - 2*b));
+      return nearestLane((double)TIMELINE_RATE/(tau + shift));
+    }
+  }
+  return UNVOICED;
+}
+
+
+/*=============< pitchLoop >==============*
+ * Analyse blocks of frames off the job   *
+ * until none are left. Runs on every     *
+ * thread, including the one that started *
+ * them.                                  *
+ *========================================*/
+static int pitchLoop(void *data) {
+  pitchjob *job = data;
+  int first;
+
+  while ((first = SDL_AtomicAdd(&job->next, FRAME_BLOCK)) < job->num_frames) {
+    int last = first + FRAME_BLOCK;
+    if (last > job->num_frames) last = job->num_frames;
+    for (int i=first; i<last; i++)
+      job->lanes[i] = yinLane(job->samples + (long)i*HOP);
+  }
+  return 0;
+}
+
+
+/*============< trackPitch >=============*
+ * Lane for every frame of samples, into *
+ * job->lanes, across every core.        *
+ *=======================================*/
+static void trackPitch(pitchjob *job) {
+  SDL_Thread **threads;
+  int num_threads = SDL_GetCPUCount() - 1;
+
+  SDL_AtomicSet(&job->next, 0);
+  if (num_threads > job->num_frames/FRAME_BLOCK)
+    num_threads = job->num_frames/FRAME_BLOCK;
+  threads = malloc((num_threads > 0 ? num_threads : 1)*sizeof(SDL_Thread*));
+  if (threads == NULL) num_threads = 0;
+  for (int i=0; i<num_threads; i++) {
+    threads[i] = SDL_CreateThread(pitchLoop, "pitch", job);
+    if (threads[i] == NULL) {
+      num_threads = i;
+      break;
+    }
+  }
+  pitchLoop(job);
+  for (int i=0; i<num_threads; i++)
+    SDL_WaitThread(threads[i], NULL);
+  free(threads);
+}
+
+
+/*=============< smoothLanes >==============*
+ * Replace each frame's lane with the most  *
+ * common one around it, so one stray frame *
+ * doesn't split a note.                    *
+ *==========================================*/
+static void smoothLanes(const int8_t *lanes, int8_t *out, int num_frames) {
+  for (int i=0; i<num_frames; i++) {
+    int votes[NUM_PITCHES+1] = {0};   // Unvoiced counts as lane -1
+    int best = lanes[i];
+
+    for (int j=i-SMOOTH_FRAMES/2; j<=i+SMOOTH_FRAMES/2; j++)
+      if (j >= 0 && j < num_frames)
+        votes[lanes[j] + 1]++;
+    for (int lane=UNVOICED; lane<NUM_PITCHES; lane++)
+      if (votes[lane + 1] > votes[best + 1])
+        best = lane;
+    out[i] = best;
+  }
+}
+
+
+/*=============< buildChart >===============*
+ * Turn per-frame lanes into notes in c.    *
+ * Silence before the first note becomes    *
+ * the offset; later gaps go to the note    *
+ * before, as charts can't rest. Returns 0  *
+ * on success.                              *
+ *==========================================*/
+static int buildChart(const int8_t *lanes, int num_frames, chart *c) {
+  segment *segs = malloc((num_frames > 0 ? num_frames : 1)*sizeof(segment));
+  int num_segs = 0, kept = 0, num_notes = 0, first = -1;
+
+  if (segs == NULL) {
+    printf("Out of memory building chart\n");
+    return 1;
+  }
+  for (int i=0; i<num_frames; i++) {
+    if (num_segs > 0 && segs[num_segs-1].lane == lanes[i])
+      segs[num_segs-1].end = i + 1;
+    else
+      segs[num_segs++] = (segment){lanes[i], i, i + 1};
+  }
+
+  // Short runs join the one before, which may then meet its own lane again
+  for (int i=0; i<num_segs; i++) {
+    if (kept > 0 && (segs[i].end - segs[i].start < MIN_NOTE_FRAMES ||
+                     segs[i].lane == segs[kept-1].lane)) {
+      segs[kept-1].end = segs[i].end;
+      continue;
+    }
+    segs[kept++] = segs[i];
+  }
+  for (int i=0; i<kept; i++)
+    if (segs[i].lane != UNVOICED) num_notes++;
+
+  if (num_notes == 0) {
+    printf("No melody found\n");
+    free(segs);
+    return 1;
+  }
+  if (allocNotes(&c->notes, num_notes)) {
+    printf("Out of memory building chart\n");
+    free(segs);
+    return 1;
+  }
+
+  for (int i=0; i<kept; i++) {
+    notearena *n = &c->notes;
+    if (segs[i].lane == UNVOICED) continue;
+    if (first < 0) first = segs[i].start;
+    n->start[n->count] = (int64_t)(segs[i].start - first)*HOP;
+    n->end[n->count] = (int64_t)(segs[i].end - first)*HOP;
+    if (n->count > 0) n->end[n->count-1] = n->start[n->count];
+    n->pitch[n->count] = segs[i].lane;
+    n->count++;
+  }
+  free(segs);
+
+  // Each pitch describes the middle of its window
+  c->offset = ((double)first*HOP + YIN_WINDOW/2)/TIMELINE_RATE;
+  addPart(c, DEFAULT_PART, 0, c->notes.count);
+  markSustains(&c->notes);
+  return 0;
+}
+
+
+int main(int argc, char* argv[]) {
+  char out_path[1024];
+  const char *in, *out, *ext;
+  int8_t *raw, *lanes;
+  float *samples;
+  long num_samples;
+  pitchjob job;
+  chart c;
+  Uint64 started;
+  int binary = 0, status;
+
+  if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+    binary = 1;
+    argv++;
+    argc--;
+  }
+  if (argc < 2 || argc > 3) {
+    printf("usage: %s [-b] song.wav [out]\n", argv[0]);
+    return 1;
+  }
+  in = argv[1];
+  ext = strrchr(in, '.');
+  if (ext && strcasecmp(ext, ".mp3") == 0) {
+    printf("%s: MP3s can't be decoded here; convert it to WAV first\n", in);
+    return 1;
+  }
+
+  started = SDL_GetPerformanceCounter();
+  num_samples = loadAudio(in, &samples);
+  if (num_samples < 0) return 1;
+
+  job.samples = samples;
+  job.num_frames = num_samples < YIN_WINDOW + MAX_LAG ? 0 :
+                   (num_samples - YIN_WINDOW - MAX_LAG)/HOP + 1;
+  raw = malloc(2*(job.num_frames > 0 ? job.num_frames : 1));
+  if (raw == NULL) {
+    printf("Out of memory analysing %s\n", in);
+    free(samples);
+    return 1;
+  }
+  job.lanes = raw;
+  lanes = raw + job.num_frames;
+  trackPitch(&job);
+  free(samples);
+  smoothLanes(raw, lanes, job.num_frames);
+
+  memset(&c, 0, sizeof(c));
+  status = buildChart(lanes, job.num_frames, &c);
+  free(raw);
+  if (status) return 1;
+
+  replaceExtension(c.mp3, sizeof(c.mp3), in, ".mp3", 0);
+  out = argv[2];
+  if (out == NULL) {
+    replaceExtension(out_path, sizeof(out_path), in,
+                     binary ? ".tmnb" : ".tmn", 1);
+    out = out_path;
+  }
+  status = binary ? saveChartBinary(&c, out) : saveChartText(&c, out);
+  if (status == 0)
+    printf("%s: %d notes in %.0f ms -> %s\n", in, c.notes.count,
+           (SDL_GetPerformanceCounter() - started)*1000.0/
+           SDL_GetPerformanceFrequency(), out);
+  freeChart(&c);
+  return status;
+}
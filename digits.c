@@ -0,0 +1,184 @@
+/*=======================*
+ |   Digit Atlas Text    |
+ *=======================*/
+
+/* Score, combo, timers and the perf HUD all change every frame, and going
+ * through TTF_RenderText + a new texture for each would be hopeless at
+ * 60 Hz. Instead the few characters they need are rasterized once per
+ * font and size into a strip texture. Strings are then composed by
+ * queueing glyph quads into a batch, which goes to the render queue as
+ * one run.
+ * Numbers are formatted by hand into caller buffers, and the batch only
+ * allocates until it reaches its working size, so a steady frame does no
+ * rasterizing and no allocating.
+ *
+ * Digits all advance by the widest digit, so numbers don't wobble as
+ * they count.
+ *
+ * Glyphs are rasterized at size*scale so they land 1:1 on screen pixels
+ * when the window is bigger than the logical WIDTH x HEIGHT; positions
+ * and widths are still given in logical pixels.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "digits.h"
+#include "hud.h"
+
+
+/*================< digitsInit >=================*
+ * Rasterize every char of charset (DIGIT_CHARS  *
+ * if NULL) at size, for drawing at scale.       *
+ * Returns 0 on success.                         *
+ *===============================================*/
+int digitsInit(digitatlas *d, SDL_Renderer *renderer, const char *fontpath,
+               int size, const char *charset, float scale) {
+  SDL_Color white = {255, 255, 255, 255};
+  SDL_Surface *glyphs[128] = {NULL};
+  SDL_Surface *strip;
+  TTF_Font *font;
+  int digit_w = 0, x = 0;
+
+  memset(d, 0, sizeof(*d));
+  if (charset == NULL) charset = DIGIT_CHARS;
+  d->scale = scale;
+
+  font = TTF_OpenFont(fontpath, (int)(size*scale + 0.5f));
+  if (font == NULL) return 1;
+
+  for (const char *c = charset; *c; c++) {
+    int ch = *c & 0x7f;
+    if (glyphs[ch]) continue;
+    glyphs[ch] = TTF_RenderGlyph_Blended(font, ch, white);
+    if (glyphs[ch] == NULL) continue;
+    d->w += glyphs[ch]->w;
+    if (glyphs[ch]->h > d->height) d->height = glyphs[ch]->h;
+    if (ch >= '0' && ch <= '9' && glyphs[ch]->w > digit_w)
+      digit_w = glyphs[ch]->w;
+  }
+  TTF_CloseFont(font);
+
+  // One strip, glyphs side by side
+  d->h = d->height;
+  d->height = (int)ceilf(d->h/scale);
+  strip = (d->w > 0) ?
+    SDL_CreateRGBSurfaceWithFormat(0, d->w, d->h, 32, SDL_PIXELFORMAT_RGBA32)
+    : NULL;
+  if (strip) SDL_FillRect(strip, NULL, SDL_MapRGBA(strip->format, 0,0,0,0));
+  for (int ch=0; ch<128; ch++) {
+    if (glyphs[ch] == NULL) continue;
+    SDL_Rect r = {x, 0, glyphs[ch]->w, glyphs[ch]->h};
+    if (strip) {
+      SDL_SetSurfaceBlendMode(glyphs[ch], SDL_BLENDMODE_NONE);
+      SDL_BlitSurface(glyphs[ch], NULL, strip, &r);
+    }
+    d->glyphs[ch] = r;
+    d->advance[ch] = (ch >= '0' && ch <= '9') ? digit_w : r.w;
+    x += r.w;
+    SDL_FreeSurface(glyphs[ch]);
+  }
+  if (strip == NULL) return 1;
+
+  d->texture = SDL_CreateTextureFromSurface(renderer, strip);
+  SDL_FreeSurface(strip);
+  if (d->texture == NULL) return 1;
+  SDL_SetTextureBlendMode(d->texture, SDL_BLENDMODE_BLEND);
+  perf.textures++;
+  return 0;
+}
+
+
+/*=========< digitsFree >==========*
+ * Texture and batch buffers.      *
+ *=================================*/
+void digitsFree(digitatlas *d) {
+  if (d->texture) {
+    SDL_DestroyTexture(d->texture);
+    perf.textures--;
+  }
+  batchFree(&d->batch);
+  memset(d, 0, sizeof(*d));
+}
+
+
+/*================< digitsText >=================*
+ * Queue str with its top left at (x, y). Chars  *
+ * not in the charset are skipped. Returns the   *
+ * width.                                        *
+ *===============================================*/
+int digitsText(digitatlas *d, float x, float y, const char *str,
+               SDL_Color color) {
+  float pen = x;
+
+  if (d->texture == NULL) return 0;
+  for (const char *c = str; *c; c++) {
+    int ch = *c & 0x7f;
+    const SDL_Rect *src = &d->glyphs[ch];
+    if (src->w == 0) continue;
+
+    // Center narrow digits in the common digit cell
+    float gw = src->w/d->scale, gh = src->h/d->scale;
+    float gx = pen + (d->advance[ch] - src->w)/2/d->scale;
+    SDL_FPoint corners[4] = {
+      {gx, y}, {gx + gw, y}, {gx + gw, y + gh}, {gx, y + gh}
+    };
+    batchRect(&d->batch, d->w, d->h, src, corners, color);
+    pen += d->advance[ch]/d->scale;
+  }
+  return (int)(pen - x);
+}
+
+
+/*==========< digitsWidth >===========*
+ * How wide digitsText would draw str *
+ *====================================*/
+int digitsWidth(const digitatlas *d, const char *str) {
+  int w = 0;
+  for (const char *c = str; *c; c++)
+    w += d->advance[*c & 0x7f];
+  return d->scale > 0 ? (int)ceilf(w/d->scale) : 0;
+}
+
+
+/*===============< formatNumber >================*
+ * Decimal value into buf, zero-padded to at     *
+ * least min_digits. buf needs 21 bytes. Returns *
+ * the length.                                   *
+ *===============================================*/
+int formatNumber(char *buf, unsigned long value, int min_digits) {
+  char tmp[20];
+  int n = 0, len = 0;
+
+  do {
+    tmp[n++] = '0' + value%10;
+    value /= 10;
+  } while ((value > 0 || n < min_digits) && n < 20);
+
+  while (n > 0)
+    buf[len++] = tmp[--n];
+  buf[len] = '\0';
+  return len;
+}
+
+
+/*================< formatTime >=================*
+ * 60 Hz frame count as m:ss into buf (needs 24  *
+ * bytes). Returns the length.                   *
+ *===============================================*/
+int formatTime(char *buf, uint64_t frames) {
+  uint64_t seconds = frames/60;
+  int len = formatNumber(buf, seconds/60, 1);
+
+  buf[len++] = ':';
+  len += formatNumber(buf + len, seconds%60, 2);
+  return len;
+}
+
+
+/*=============< digitsQueue >==============*
+ * Move every queued glyph into layer of q. *
+ *==========================================*/
+void digitsQueue(digitatlas *d, renderqueue *q, int layer) {
+  queueBatch(q, layer, &d->batch, d->texture);
+}
@@ -0,0 +1,37 @@
+/* Digit Atlas Text */
+
+#ifndef DIGITS_H
+#define DIGITS_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#include "atlas.h"
+#include "renderqueue.h"
+
+#define DIGIT_CHARS "0123456789.:%/-+x, "   // Default glyph set
+
+/* Glyphs rasterized once for one font and size, plus a batch to compose
+ * strings from them without touching SDL_ttf again. */
+typedef struct {
+  SDL_Texture *texture;
+  int w, h;                     // Texture size
+  SDL_Rect glyphs[128];         // Source rect per ASCII char (w=0: missing)
+  int advance[128];             // Pen movement per char, in texture pixels
+  int height;                   // Line height, in logical pixels
+  float scale;                  // Texture pixels per logical pixel
+  spritebatch batch;
+} digitatlas;
+
+int digitsInit(digitatlas *d, SDL_Renderer *renderer, const char *fontpath,
+               int size, const char *charset, float scale);
+void digitsFree(digitatlas *d);
+
+int digitsText(digitatlas *d, float x, float y, const char *str,
+               SDL_Color color);
+int digitsWidth(const digitatlas *d, const char *str);
+int formatNumber(char *buf, unsigned long value, int min_digits);
+int formatTime(char *buf, uint64_t frames);
+void digitsQueue(digitatlas *d, renderqueue *q, int layer);
+
+#endif
@@ -0,0 +1,222 @@
+/*=======================*
+ |   Dirty Rect Redraw   |
+ *=======================*/
+
+/* For machines where SDL falls back to the software renderer. There we
+ * draw straight into the window surface, which keeps last frame's pixels,
+ * so only the parts of the screen that changed need redrawing: tiles
+ * under anything that moves (notes, player block, sparks) this frame or
+ * last frame, the pitch label when it changes, and the HUD. Those tiles
+ * are merged into a few rects, the scene is redrawn clipped to each, and
+ * only those rects are pushed with SDL_UpdateWindowSurfaceRects.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "dirty.h"
+#include "hud.h"
+#include "particles.h"
+
+
+/*===========< initDirty >============*
+ * First frame is always a full one.  *
+ *====================================*/
+void initDirty(dirtytracker *d) {
+  memset(d, 0, sizeof(*d));
+  d->full = 1;
+}
+
+
+/*============< markRect >=============*
+ * Flag every tile r touches.          *
+ *=====================================*/
+static void markRect(Uint8 tiles[DIRTY_ROWS][DIRTY_COLS], float x0, float y0,
+                     float x1, float y1) {
+  int c0 = SDL_max((int)x0/DIRTY_TILE, 0);
+  int r0 = SDL_max((int)y0/DIRTY_TILE, 0);
+  int c1 = SDL_min((int)x1/DIRTY_TILE, DIRTY_COLS-1);
+  int r1 = SDL_min((int)y1/DIRTY_TILE, DIRTY_ROWS-1);
+
+  for (int r=r0; r<=r1; r++)
+    for (int c=c0; c<=c1; c++)
+      tiles[r][c] = 1;
+}
+
+
+/*============< markQuads >=============*
+ * Flag the bounding box of each quad   *
+ * in the batch from first on.          *
+ *======================================*/
+static void markQuads(Uint8 tiles[DIRTY_ROWS][DIRTY_COLS],
+                      const spritebatch *b, int first) {
+  for (int q=first; q<b->num_quads; q++) {
+    const SDL_Vertex *v = &b->verts[q*4];
+    float x0 = v[0].position.x, x1 = x0, y0 = v[0].position.y, y1 = y0;
+    for (int k=1; k<4; k++) {
+      x0 = SDL_min(x0, v[k].position.x);
+      x1 = SDL_max(x1, v[k].position.x);
+      y0 = SDL_min(y0, v[k].position.y);
+      y1 = SDL_max(y1, v[k].position.y);
+    }
+    if (x1 < 0 || y1 < 0 || x0 >= WIDTH || y0 >= HEIGHT) continue;
+    markRect(tiles, x0, y0, x1, y1);
+  }
+}
+
+
+/*===============< mergeTiles >================*
+ * Turn flagged tiles into rects: runs along   *
+ * each row, then stack identical runs from    *
+ * consecutive rows. Returns the rect count,   *
+ * or -1 if a full redraw would be cheaper.    *
+ *=============================================*/
+static int mergeTiles(Uint8 tiles[DIRTY_ROWS][DIRTY_COLS], SDL_Rect *rects) {
+  int n = 0, dirty = 0;
+  int open_from = 0;          // Rects from earlier rows still growing
+
+  for (int r=0; r<DIRTY_ROWS; r++) {
+    int row_start = n;
+    for (int c=0; c<DIRTY_COLS; ) {
+      int c0 = c, merged = 0;
+      if (!tiles[r][c]) {
+        c++;
+        continue;
+      }
+      while (c < DIRTY_COLS && tiles[r][c]) c++;
+      dirty += c - c0;
+
+      // Extend the same span from the row above if there is one
+      for (int k=open_from; k<row_start; k++) {
+        if (rects[k].x == c0*DIRTY_TILE && rects[k].w == (c-c0)*DIRTY_TILE &&
+            rects[k].y + rects[k].h == r*DIRTY_TILE) {
+          rects[k].h += DIRTY_TILE;
+          merged = 1;
+          break;
+        }
+      }
+      if (merged) continue;
+      if (n == DIRTY_MAX_RECTS) return -1;
+      rects[n++] = (SDL_Rect){c0*DIRTY_TILE, r*DIRTY_TILE,
+                              (c-c0)*DIRTY_TILE, DIRTY_TILE};
+    }
+    // Rects that didn't grow into this row are finished
+    while (open_from < row_start &&
+           rects[open_from].y + rects[open_from].h < (r+1)*DIRTY_TILE)
+      open_from++;
+  }
+
+  if (dirty*100 > DIRTY_ROWS*DIRTY_COLS*DIRTY_FULL_PERCENT) return -1;
+  return n;
+}
+
+
+/*==============< toWindow >===============*
+ * Logical rect to window surface pixels,  *
+ * rounded outward.                        *
+ *=========================================*/
+static SDL_Rect toWindow(SDL_Renderer *renderer, SDL_Rect r) {
+  SDL_Rect view;
+  float sx, sy;
+  int x0, y0, x1, y1;
+
+  SDL_RenderGetViewport(renderer, &view);
+  SDL_RenderGetScale(renderer, &sx, &sy);
+  x0 = (int)floorf((view.x + r.x)*sx);
+  y0 = (int)floorf((view.y + r.y)*sy);
+  x1 = (int)ceilf((view.x + r.x + r.w)*sx);
+  y1 = (int)ceilf((view.y + r.y + r.h)*sy);
+  return (SDL_Rect){x0, y0, x1 - x0, y1 - y0};
+}
+
+
+/*=================< renderDirty >==================*
+ * Draw and present one frame on the software path, *
+ * touching only what changed. renderer must draw   *
+ * into window's surface.                           *
+ *==================================================*/
+void renderDirty(dirtytracker *d, SDL_Window *window, SDL_Renderer *renderer,
+                 TTF_Font *font, const gamestate *state) {
+  Uint8 now[DIRTY_ROWS][DIRTY_COLS];
+  Uint8 both[DIRTY_ROWS][DIRTY_COLS];
+  SDL_Rect rects[DIRTY_MAX_RECTS];
+  int n, first_moving;
+
+  // The song menu changes all over with a key press: draw the lot
+  if (state->menu.active) {
+    renderFrame(renderer, font, state, NULL);
+    SDL_RenderFlush(renderer);
+    SDL_UpdateWindowSurface(window);
+    d->full = 1;              // Back in the game, start from a clean slate
+    return;
+  }
+
+  // Lay out the frame; lanes don't move so they don't count as damage
+  queueLanes(state);
+  first_moving = sprites.num_quads;
+  queueNotes(state);
+  queuePlayer(state);
+  drawParticles(&particles, &sprites, &game_atlas);
+
+  memset(now, 0, sizeof(now));
+  markQuads(now, &sprites, first_moving);
+  if (state->hud) {
+    SDL_Rect h = hudRect();
+    markRect(now, h.x, h.y, h.x + h.w - 1, h.y + h.h - 1);
+  }
+  if (score_digits.texture)     // Song time ticks every second anyway
+    markRect(now, scoreRect.x, scoreRect.y, scoreRect.x + scoreRect.w - 1,
+             scoreRect.y + scoreRect.h - 1);
+  if (state->pitchindex != d->pitchindex)
+    markRect(now, pitchRect.x, pitchRect.y, pitchRect.x + pitchRect.w - 1,
+             pitchRect.y + pitchRect.h - 1);
+
+  // Anything that changes the whole look forces a full redraw
+  if (state->colorblind != d->colorblind ||
+      state->perspective != d->perspective || state->hud != d->hud)
+    d->full = 1;
+
+  // Redraw where things are now and where they were last frame
+  for (int r=0; r<DIRTY_ROWS; r++)
+    for (int c=0; c<DIRTY_COLS; c++)
+      both[r][c] = now[r][c] | d->tiles[r][c];
+  n = d->full ? -1 : mergeTiles(both, rects);
+  if (n < 0) {
+    rects[0] = (SDL_Rect){0, 0, WIDTH, HEIGHT};
+    n = 1;
+  }
+
+  // Queue the frame once, then draw it under each clip rect
+  queueClear(&frame_queue);
+  if (font)
+    drawText(renderer, font, state);
+  drawScore(state);
+  queueBatch(&frame_queue, LAYER_WORLD, &sprites, game_atlas.texture);
+  if (state->hud)
+    hudDraw(&frame_queue);
+
+  for (int i=0; i<n; i++) {
+    // A full redraw also clears the letterbox bars around the play area
+    SDL_RenderSetClipRect(renderer, d->full ? NULL : &rects[i]);
+    drawBackground(renderer, state);
+    queueDraw(&frame_queue, renderer);
+  }
+  SDL_RenderSetClipRect(renderer, NULL);
+
+  SDL_RenderFlush(renderer);
+  if (d->full) {
+    SDL_UpdateWindowSurface(window);
+  }
+  else {
+    for (int i=0; i<n; i++)
+      rects[i] = toWindow(renderer, rects[i]);
+    SDL_UpdateWindowSurfaceRects(window, rects, n);
+  }
+
+  memcpy(d->tiles, now, sizeof(now));
+  d->full = 0;
+  d->pitchindex = state->pitchindex;
+  d->colorblind = state->colorblind;
+  d->perspective = state->perspective;
+  d->hud = state->hud;
+}
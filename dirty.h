@@ -0,0 +1,27 @@
+/* Dirty Rectangle Redraw */
+
+#ifndef DIRTY_H
+#define DIRTY_H
+
+#include "game.h"
+
+#define DIRTY_TILE 32                 // Damage is tracked per tile
+#define DIRTY_COLS ((WIDTH+DIRTY_TILE-1)/DIRTY_TILE)
+#define DIRTY_ROWS ((HEIGHT+DIRTY_TILE-1)/DIRTY_TILE)
+#define DIRTY_MAX_RECTS 32            // More than this: just redraw it all
+#define DIRTY_FULL_PERCENT 60         // Likewise past this much of the screen
+
+typedef struct {
+  Uint8 tiles[DIRTY_ROWS][DIRTY_COLS];  // What changed last frame
+  int full;                             // Redraw everything next frame
+  int pitchindex;                       // What last frame showed
+  int colorblind;
+  int perspective;
+  int hud;
+} dirtytracker;
+
+void initDirty(dirtytracker *d);
+void renderDirty(dirtytracker *d, SDL_Window *window, SDL_Renderer *renderer,
+                 TTF_Font *font, const gamestate *state);
+
+#endif
@@ -0,0 +1,76 @@
+/* Game-wide definitions shared between the game and its tools */
+
+#ifndef GAME_H
+#define GAME_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#include "theremin.h"
+#include "atlas.h"
+#include "state.h"
+#include "digits.h"
+#include "renderqueue.h"
+
+#define WIDTH 512     // Logical size; scaled to fit the window
+#define HEIGHT 768
+
+#define FONT_PATH "/Library/Fonts/Impact.ttf"
+
+#define NUM_PITCHES 8
+#define HITLINE ((int)(5.0/6.0*HEIGHT))   // Where notes should be played
+#define SCROLL_SPEED 4                    // Pixels a note falls per frame
+#define SCROLL_PIXELS(samples) ((samples)*(SCROLL_SPEED*60.0/TIMELINE_RATE))
+// Samples from a note's end until it has scrolled off the bottom
+#define SCROLLED_OFF ((int64_t)((HEIGHT - HITLINE)/SCROLL_PIXELS(1.0)))
+
+#define LANE_WIDTH 50
+#define LANE_X(i) ((i)*LANE_WIDTH+50)     // Left edge of lane i
+#define NOTE_HEIGHT 25
+#define SUSTAIN_WIDTH (LANE_WIDTH/3)      // Trail behind notes held a while
+
+#define SCORE_FONT_SIZE 28
+#define SCORE_LINE 36                     // Line height of the score digits
+
+/* Render stages, timed separately by the benchmark */
+enum {
+  STAGE_CLEAR,
+  STAGE_TEXT,
+  STAGE_LANES,
+  STAGE_NOTES,
+  STAGE_PLAYER,
+  STAGE_PARTICLES,
+  STAGE_HUD,
+  NUM_STAGES
+};
+
+extern uint64_t frame_cntr;
+extern char* pitchNames[];
+extern const char* stageNames[];
+extern const SDL_Rect titleRect;
+extern const SDL_Rect pitchRect;
+extern const SDL_Rect scoreRect;
+
+extern atlas game_atlas;
+extern spritebatch sprites;
+extern renderqueue frame_queue;
+extern digitatlas score_digits;
+
+int prefFilePath(char *out, size_t len, const char *name);
+void drawNotes(const notearena *notes, int start, int end, int64_t now,
+               int held, int backing);
+void scrollParts(gamestate *state);
+void seekParts(gamestate *state);
+void judgeNotes(gamestate *state);
+void playEffects(const gamestate *state, Uint32 *seen);
+void drawBackground(SDL_Renderer *renderer, const gamestate *state);
+void drawText(SDL_Renderer *renderer, TTF_Font *font,
+              const gamestate *state);
+void drawScore(const gamestate *state);
+void queueLanes(const gamestate *state);
+void queueNotes(const gamestate *state);
+void queuePlayer(const gamestate *state);
+void renderFrame(SDL_Renderer *renderer, TTF_Font *font,
+                 const gamestate *state, double *stage_ms);
+
+#endif
@@ -0,0 +1,129 @@
+/*=======================*
+ |   Quality Governor    |
+ *=======================*/
+
+/* Steps visual and audio quality down when the machine can't keep up,
+ * and back up when it has room again, so slow cabinets lose sparks
+ * instead of dropping frames or underrunning the audio device.
+ *
+ * Every GOVERNOR_WINDOW frames the render thread's frame interval, its
+ * draw time and the worst audio callback load are compared against
+ * their budgets. A window is bad if frames came late or either thread
+ * used most of its budget, and good if both had plenty left over.
+ * Stepping down takes GOVERNOR_DOWN bad windows in a row; stepping up
+ * takes up_after good ones. If quality has to come back down soon after
+ * stepping up, up_after doubles, so a machine sitting on the edge
+ * settles instead of flipping between two levels.
+ */
+
+#include <string.h>
+
+#include "governor.h"
+#include "hud.h"
+
+governor quality;
+
+const qualitysettings qualityLevels[NUM_QUALITY] = {
+  /* sparks  cap   fm step */
+  {  100,    8192, 1 },     // High
+  {  50,     2048, 1 },     // Medium
+  {  25,     512,  4 },     // Low
+  {  0,      0,    16 }     // Minimal
+};
+
+const char* qualityNames[] = {
+  "high",
+  "medium",
+  "low",
+  "minimal"
+};
+
+
+/*===============< initGovernor >================*
+ * Start adaptive at full quality, or fixed at   *
+ * level pinned (-1 for adaptive).               *
+ *===============================================*/
+void initGovernor(governor *g, int pinned) {
+  memset(g, 0, sizeof(*g));
+  g->pinned = (pinned >= 0);
+  g->up_after = GOVERNOR_UP;
+  g->since_up = 2*GOVERNOR_UP_MAX;    // Not coming from a step up
+  SDL_AtomicSet(&g->level, g->pinned ? pinned : QUALITY_HIGH);
+  perf.quality = SDL_AtomicGet(&g->level);
+}
+
+
+/*================< governFrame >=================*
+ * Call once per presented frame with the time    *
+ * since the last one and the time spent drawing. *
+ *================================================*/
+void governFrame(governor *g, double frame_ms, double draw_ms) {
+  int level = SDL_AtomicGet(&g->level);
+  int audio = SDL_AtomicGet(&perf.audio_load);
+  double frame, draw;
+
+  if (g->pinned) return;
+
+  g->frame_sum += frame_ms;
+  g->draw_sum += draw_ms;
+  if (audio > g->audio_max) g->audio_max = audio;
+  if (++g->frames < GOVERNOR_WINDOW) return;
+
+  frame = g->frame_sum/g->frames;
+  draw = g->draw_sum/g->frames;
+
+  // Bad: late frames, or a thread using most of its budget
+  if (frame > FRAME_BUDGET_MS*1.2 || draw > FRAME_BUDGET_MS*0.9 ||
+      g->audio_max > 7500) {
+    g->bad++;
+    g->good = 0;
+  }
+  // Good: on time, with half the budget or more to spare
+  else if (frame < FRAME_BUDGET_MS*1.1 && draw < FRAME_BUDGET_MS*0.5 &&
+           g->audio_max < 4000) {
+    g->good++;
+    g->bad = 0;
+  }
+  else {
+    g->bad = g->good = 0;
+  }
+  g->since_up++;
+
+  if (g->bad >= GOVERNOR_DOWN && level < QUALITY_MINIMAL) {
+    // Just came up from here and it didn't hold: wait longer next time
+    if (g->since_up < 2*g->up_after && g->up_after < GOVERNOR_UP_MAX)
+      g->up_after *= 2;
+    SDL_AtomicSet(&g->level, ++level);
+    g->bad = 0;
+  }
+  else if (g->good >= g->up_after && level > QUALITY_HIGH) {
+    SDL_AtomicSet(&g->level, --level);
+    g->good = 0;
+    g->since_up = 0;
+  }
+  perf.quality = level;
+
+  g->frames = 0;
+  g->frame_sum = g->draw_sum = 0;
+  g->audio_max = 0;
+}
+
+
+/*=============< currentQuality >==============*
+ * Settings for the level in force right now.  *
+ * Safe to call from any thread.               *
+ *=============================================*/
+const qualitysettings *currentQuality(governor *g) {
+  return &qualityLevels[SDL_AtomicGet(&g->level)];
+}
+
+
+/*==============< qualityByName >===============*
+ * Level for "high", "medium", "low" or         *
+ * "minimal", or -1.                            *
+ *==============================================*/
+int qualityByName(const char *name) {
+  for (int i=0; i<NUM_QUALITY; i++)
+    if (strcmp(name, qualityNames[i]) == 0) return i;
+  return -1;
+}
@@ -0,0 +1,53 @@
+/* Quality Governor */
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <SDL2/SDL.h>
+
+#define FRAME_BUDGET_MS (1000.0/60)
+#define GOVERNOR_WINDOW 30    // Frames per measurement
+#define GOVERNOR_DOWN   2     // Bad windows in a row before stepping down
+#define GOVERNOR_UP     10    // Good windows in a row before stepping up
+#define GOVERNOR_UP_MAX 80    // Longest the step up can be put off
+
+/* Best first, so a zeroed governor runs at full quality */
+enum {
+  QUALITY_HIGH,
+  QUALITY_MEDIUM,
+  QUALITY_LOW,
+  QUALITY_MINIMAL,
+  NUM_QUALITY
+};
+
+typedef struct {
+  int particle_percent;   // Share of HIT_PARTICLES/MISS_PARTICLES emitted
+  int max_particles;      // No new sparks past this many live ones
+  int fm_step;            // Samples between FM modulator evaluations
+} qualitysettings;
+
+typedef struct {
+  SDL_atomic_t level;     // Read from the render and audio threads
+  int pinned;             // Level fixed on the command line
+
+  // Current window
+  int frames;
+  double frame_sum, draw_sum;
+  int audio_max;          // Worst callback load, in perf.audio_load units
+
+  // Hysteresis
+  int bad, good;          // Windows in a row over/well under budget
+  int up_after;           // Good windows needed to step up; backs off
+  int since_up;           // Windows since the last step up
+} governor;
+
+extern governor quality;
+extern const qualitysettings qualityLevels[NUM_QUALITY];
+extern const char* qualityNames[];
+
+void initGovernor(governor *g, int pinned);
+void governFrame(governor *g, double frame_ms, double draw_ms);
+const qualitysettings *currentQuality(governor *g);
+int qualityByName(const char *name);
+
+#endif
@@ -0,0 +1,136 @@
+/*=======================*
+ |  Perspective Highway  |
+ *=======================*/
+
+/* Same highway as the flat view, tilted away from the player. Everything
+ * is laid out in the flat view's coordinates (lane x, and z = how far
+ * above the hit line something would be), then pushed through a
+ * depth-to-screen table built once at startup. Lanes, notes and the
+ * player block all become quads in the sprite batch, so the 3D view is
+ * still one draw call per frame.
+ */
+
+#include "highway.h"
+
+#define HIGHWAY_CENTER (LANE_X(0) + NUM_PITCHES*LANE_WIDTH/2.0f)
+
+typedef struct {
+  float y;          // Screen y of this depth
+  float scale;      // Horizontal shrink toward HIGHWAY_CENTER
+} depthentry;
+
+static depthentry depth_table[HIGHWAY_FAR - HIGHWAY_NEAR + 1];
+
+
+/*=============< initHighway >==============*
+ * Fill the depth table: z = 0 lands on the *
+ * hit line at full size, and things shrink *
+ * toward the horizon as z grows.           *
+ *==========================================*/
+void initHighway(void) {
+  for (int z=HIGHWAY_NEAR; z<=HIGHWAY_FAR; z++) {
+    float scale = HIGHWAY_FOCAL/(HIGHWAY_FOCAL + z);
+    depth_table[z - HIGHWAY_NEAR].scale = scale;
+    depth_table[z - HIGHWAY_NEAR].y =
+      HIGHWAY_HORIZON + (HITLINE - HIGHWAY_HORIZON)*scale;
+  }
+}
+
+
+/*==========< project >===========*
+ * Flat (x, z) to screen, clamped *
+ * to the ends of the highway.    *
+ *================================*/
+static SDL_FPoint project(float x, int z) {
+  const depthentry *d;
+
+  if (z < HIGHWAY_NEAR) z = HIGHWAY_NEAR;
+  if (z > HIGHWAY_FAR) z = HIGHWAY_FAR;
+  d = &depth_table[z - HIGHWAY_NEAR];
+  return (SDL_FPoint){HIGHWAY_CENTER + (x - HIGHWAY_CENTER)*d->scale, d->y};
+}
+
+
+/*==========< batchSlab >===========*
+ * Quad covering x0..x1 between     *
+ * depths znear and zfar.           *
+ *==================================*/
+static void batchSlab(spritebatch *b, const atlas *a, int sprite,
+                      float x0, float x1, int znear, int zfar,
+                      SDL_Color color) {
+  SDL_FPoint corners[4] = {
+    project(x0, zfar), project(x1, zfar),
+    project(x1, znear), project(x0, znear)
+  };
+  batchQuad(b, a, sprite, corners, color);
+}
+
+
+/*==========< drawHighwayLanes >==========*
+ * Lane separators, near end to far end. *
+ *========================================*/
+void drawHighwayLanes(spritebatch *b, const atlas *a) {
+  SDL_Color darkBlue = {5, 42, 100, 255};
+  for (int i=0; i<=NUM_PITCHES; i++)
+    batchSlab(b, a, SPRITE_LANE, LANE_X(i)-2, LANE_X(i)+2,
+              HIGHWAY_NEAR, HIGHWAY_FAR, darkBlue);
+}
+
+
+/*===============< drawHighwayNotes >================*
+ * Perspective drawNotes: same timing, sustains and  *
+ * held notes, backing parts faint, but notes are    *
+ * visible all the way to HIGHWAY_FAR.               *
+ *===================================================*/
+void drawHighwayNotes(spritebatch *b, const atlas *a, const notearena *notes,
+                      int start, int end, int64_t now, int held,
+                      int backing) {
+  SDL_Color orange = {255, 140, 0, 255};
+  SDL_Color trail = {255, 140, 0, 160};
+  SDL_Color lit = {255, 200, 40, 255};
+  SDL_Color dull = {120, 120, 120, 160};
+  int z, far, near;
+
+  if (backing) {
+    orange = (SDL_Color){90, 170, 255, 120};
+    trail = (SDL_Color){90, 170, 255, 70};
+    held = -1;
+  }
+
+  for (int i=start; i<=end; i++) {
+    int64_t t = notes->start[i];
+    int x = LANE_X(notes->pitch[i]);
+    int playing = (t <= now && now < notes->end[i]);
+    int holding = playing && notes->pitch[i] == held;
+    SDL_Color color = holding ? lit : (t <= now) ? dull : trail;
+
+    z = (int)SCROLL_PIXELS(t - now);          // Depth of the note's top
+    if (z - NOTE_HEIGHT > HIGHWAY_FAR) break;
+    if (holding) z = 0;
+
+    // Trail from under the head to where the next note's head would be
+    if (notes->flags[i] & NOTE_SUSTAIN) {
+      far = (int)SCROLL_PIXELS(notes->end[i] - now) - NOTE_HEIGHT;
+      near = z - NOTE_HEIGHT/2;
+      if (far > HIGHWAY_FAR) far = HIGHWAY_FAR;
+      if (near < HIGHWAY_NEAR) near = HIGHWAY_NEAR;
+      if (far > z && far > near)
+        batchSlab(b, a, SPRITE_WHITE, x + (LANE_WIDTH - SUSTAIN_WIDTH)/2,
+                  x + (LANE_WIDTH + SUSTAIN_WIDTH)/2, near, far, color);
+    }
+
+    if (z > HIGHWAY_NEAR)
+      batchSlab(b, a, SPRITE_GEM, x, x + LANE_WIDTH,
+                z - NOTE_HEIGHT, z, holding ? lit : orange);
+  }
+}
+
+
+/*==========< drawHighwayPlayer >===========*
+ * Player block, just under the hit line.   *
+ *==========================================*/
+void drawHighwayPlayer(spritebatch *b, const atlas *a, int index) {
+  SDL_Color blue = {0, 0, 255, 255};
+  batchSlab(b, a, SPRITE_PLAYER, LANE_X(index), LANE_X(index) + LANE_WIDTH,
+            -NOTE_HEIGHT, 0, blue);
+}
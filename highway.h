@@ -0,0 +1,20 @@
+/* Perspective Note Highway */
+
+#ifndef HIGHWAY_H
+#define HIGHWAY_H
+
+#include "game.h"
+
+#define HIGHWAY_NEAR   (-NOTE_HEIGHT)   // Flat distance below hit line drawn
+#define HIGHWAY_FAR    1600             // Flat distance at the far end
+#define HIGHWAY_FOCAL  400.0f           // Smaller = stronger perspective
+#define HIGHWAY_HORIZON 40              // Screen y the highway vanishes to
+
+void initHighway(void);
+void drawHighwayLanes(spritebatch *b, const atlas *a);
+void drawHighwayNotes(spritebatch *b, const atlas *a, const notearena *notes,
+                      int start, int end, int64_t now, int held,
+                      int backing);
+void drawHighwayPlayer(spritebatch *b, const atlas *a, int index);
+
+#endif
@@ -0,0 +1,191 @@
+/*=======================*
+ |  Performance Overlay  |
+ *=======================*/
+
+/* Toggleable overlay with frame time percentiles, audio callback load,
+ * draw call/texture counts, text cache hit rate, quality level and
+ * resident memory.
+ *
+ * Every glyph the HUD can print goes into a digit atlas in hudInit, so
+ * the HUD is one queued fill plus one run of glyph quads, and never calls
+ * into SDL_ttf.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __APPLE__
+  #include <mach/mach.h>
+#else
+  #include <unistd.h>
+#endif
+
+#include "hud.h"
+#include "digits.h"
+#include "governor.h"
+
+#define HUD_FONT_SIZE 14
+#define HUD_GLYPHS " 0123456789.%:/-abcdefghijklmnopqrstuvwxyzKMB"
+
+perfcounters perf;
+int hud_visible = 0;
+
+static digitatlas glyphs;
+
+static float frame_ms[HUD_FRAME_SAMPLES]; // Ring buffer of frame times
+static int frame_count = 0;
+static int frame_head = 0;
+static int frames_since_refresh = 0;
+
+static perfcounters last_frame;           // What the HUD is showing
+static char hud_lines[6][64];
+static int num_lines = 5;
+
+
+/*============< residentKB >=============*
+ * Resident set size of the process, or  *
+ * -1 if this platform won't tell us.    *
+ *=======================================*/
+static long residentKB(void) {
+#if defined(__APPLE__)
+  struct mach_task_basic_info info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                (task_info_t)&info, &count) != KERN_SUCCESS)
+    return -1;
+  return info.resident_size/1024;
+#elif defined(__linux__)
+  long pages = -1;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f == NULL) return -1;
+  if (fscanf(f, "%*s %ld", &pages) != 1) pages = -1;
+  fclose(f);
+  return (pages < 0) ? -1 : pages*(sysconf(_SC_PAGESIZE)/1024);
+#else
+  return -1;
+#endif
+}
+
+
+static int compareFloats(const void *a, const void *b) {
+  float fa = *(const float*)a, fb = *(const float*)b;
+  return (fa > fb) - (fa < fb);
+}
+
+
+/*==============< hudInit >===============*
+ * Pre-render the HUD glyphs for drawing   *
+ * at scale. Returns 0 on success.         *
+ *=========================================*/
+int hudInit(SDL_Renderer *renderer, const char *fontpath, float scale) {
+  return digitsInit(&glyphs, renderer, fontpath, HUD_FONT_SIZE, HUD_GLYPHS,
+                    scale);
+}
+
+
+/*=============< hudAudioLoad >==============*
+ * Called from the audio callback with the   *
+ * time it took to fill a buffer of samples. *
+ *===========================================*/
+void hudAudioLoad(Uint64 elapsed, int samples, int freq) {
+  double budget = (double)samples/freq;
+  double spent = (double)elapsed/SDL_GetPerformanceFrequency();
+  int load = (int)(spent/budget*10000);
+  int peak;
+
+  SDL_AtomicSet(&perf.audio_load, load);
+  do {
+    peak = SDL_AtomicGet(&perf.audio_peak);
+  } while (load > peak && !SDL_AtomicCAS(&perf.audio_peak, peak, load));
+}
+
+
+/*==============< hudEndFrame >===============*
+ * Record this frame's time and counters, and *
+ * refresh the numbers every HUD_REFRESH.     *
+ *============================================*/
+void hudEndFrame(double ms) {
+  frame_ms[frame_head] = ms;
+  frame_head = (frame_head+1)%HUD_FRAME_SAMPLES;
+  if (frame_count < HUD_FRAME_SAMPLES) frame_count++;
+
+  last_frame.draw_calls = perf.draw_calls;
+  last_frame.textures = perf.textures;
+  last_frame.textures_created = perf.textures_created;
+  perf.draw_calls = 0;
+  perf.textures_created = 0;
+
+  if (++frames_since_refresh < HUD_REFRESH) return;
+  frames_since_refresh = 0;
+
+  {
+    float sorted[HUD_FRAME_SAMPLES];
+    int lookups = perf.text_hits + perf.text_misses;
+    long rss = residentKB();
+
+    memcpy(sorted, frame_ms, frame_count*sizeof(float));
+    qsort(sorted, frame_count, sizeof(float), compareFloats);
+
+    snprintf(hud_lines[0], sizeof(hud_lines[0]),
+             "p50 %.1f  p99 %.1f  max %.1f ms",
+             sorted[frame_count/2], sorted[frame_count*99/100],
+             sorted[frame_count-1]);
+    snprintf(hud_lines[1], sizeof(hud_lines[1]), "audio %.1f%%  peak %.1f%%",
+             SDL_AtomicGet(&perf.audio_load)/100.0,
+             SDL_AtomicGet(&perf.audio_peak)/100.0);
+    snprintf(hud_lines[2], sizeof(hud_lines[2]), "draws %d  tex %d  new %d",
+             last_frame.draw_calls, last_frame.textures,
+             last_frame.textures_created);
+    snprintf(hud_lines[3], sizeof(hud_lines[3]), "text hit %d%%  quality %s",
+             lookups ? perf.text_hits*100/lookups : 100,
+             qualityNames[perf.quality]);
+    if (rss < 0)
+      snprintf(hud_lines[4], sizeof(hud_lines[4]), "rss -");
+    else
+      snprintf(hud_lines[4], sizeof(hud_lines[4]), "rss %ld KB", rss);
+    num_lines = 5;
+    if (perf.capturing) {
+      snprintf(hud_lines[5], sizeof(hud_lines[5]), "cap %.2f ms  drop %d",
+               perf.capture_ms, perf.capture_drops);
+      num_lines = 6;
+    }
+  }
+  perf.text_hits = 0;
+  perf.text_misses = 0;
+  SDL_AtomicSet(&perf.audio_peak, 0);
+}
+
+
+/*===========< hudRect >============*
+ * Screen area the overlay covers.  *
+ *==================================*/
+SDL_Rect hudRect(void) {
+  SDL_Rect panel = {0, 0, 260, num_lines*glyphs.height+8};
+  return panel;
+}
+
+
+/*=================< hudDraw >==================*
+ * Queue the overlay in the top left corner.    *
+ * Uses only the glyphs from hudInit.           *
+ *==============================================*/
+void hudDraw(renderqueue *q) {
+  SDL_Color white = {255, 255, 255, 255};
+  SDL_Color shade = {0, 0, 0, 160};
+  SDL_Rect panel = hudRect();
+
+  if (glyphs.texture == NULL) return;
+
+  queueFill(q, LAYER_OVERLAY, &panel, shade);
+  for (int line=0; line<num_lines; line++)
+    digitsText(&glyphs, 4, 4+line*glyphs.height, hud_lines[line], white);
+  digitsQueue(&glyphs, q, LAYER_OVERLAY_TEXT);
+}
+
+
+/*===========< hudQuit >===========*
+ * Free the glyphs.                *
+ *=================================*/
+void hudQuit(void) {
+  digitsFree(&glyphs);
+}
@@ -0,0 +1,40 @@
+/* Performance HUD */
+
+#ifndef HUD_H
+#define HUD_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#include "renderqueue.h"
+
+#define HUD_FRAME_SAMPLES 256   // Frame times kept for percentiles
+#define HUD_REFRESH       30    // Frames between HUD number updates
+
+/* Counters bumped by the rest of the game. Per-frame ones are reset by
+ * hudEndFrame; audio_load is written from the audio thread. */
+typedef struct {
+  int draw_calls;             // SDL draw calls issued this frame
+  int textures;               // Live textures we own
+  int textures_created;       // Textures created this frame
+  int text_hits;              // Text cache lookups since last refresh
+  int text_misses;
+  SDL_atomic_t audio_load;    // Last callback time / buffer time, 0.01% units
+  SDL_atomic_t audio_peak;    // Worst since last refresh, same units
+  int capturing;              // Video capture running?
+  float capture_ms;           // Time captureFrame took this frame
+  int capture_drops;          // Frames dropped since capture started
+  int quality;                // Level the governor has us at
+} perfcounters;
+
+extern perfcounters perf;
+extern int hud_visible;
+
+int hudInit(SDL_Renderer *renderer, const char *fontpath, float scale);
+void hudAudioLoad(Uint64 elapsed, int samples, int freq);
+void hudEndFrame(double frame_ms);
+void hudDraw(renderqueue *q);
+SDL_Rect hudRect(void);
+void hudQuit(void);
+
+#endif
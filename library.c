@@ -0,0 +1,354 @@
+/*=======================*
+ |     Song Library      |
+ *=======================*/
+
+/* Finds every chart in songs/ and keeps what the song list shows about
+ * each (MP3, offset, note count, length, pitch range) in a cache file, so
+ * startup doesn't parse thousands of charts. Each launch lists the
+ * directory and stats every chart. Only charts whose mtime or size differ
+ * from the cache are read again, spread over a few threads; the rest come
+ * straight from the cache.
+ *
+ * The cache is native-endian, like the machine that wrote it:
+ *
+ *   "TMNL", version, song count
+ *   per song: a libraryrecord, then its file and MP3 names (no NULs)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <SDL2/SDL.h>
+
+#include "library.h"
+#include "game.h"
+
+typedef struct {
+  int64_t mtime, size, length;
+  double offset;
+  int32_t num_notes;
+  uint8_t low, high, ok, reserved;
+  uint16_t file_len, mp3_len;
+  uint32_t reserved2;
+} libraryrecord;
+
+/* Charts left to read, shared by the scan threads */
+typedef struct {
+  library *lib;
+  int *todo;                  // Indices into lib->songs
+  int num_todo;
+  SDL_atomic_t next;          // Next todo to hand out
+} scanjob;
+
+
+static int compareSongs(const void *a, const void *b) {
+  return strcmp(((const songinfo*)a)->file, ((const songinfo*)b)->file);
+}
+
+
+/*==============< readCache >===============*
+ * Songs from the cache file, sorted, into  *
+ * *songs. Returns how many; 0 if there is  *
+ * no cache or it can't be used.            *
+ *==========================================*/
+static int readCache(songinfo **songs) {
+  char path[1024];
+  char *data = NULL;
+  const char *p, *end;
+  uint32_t version, count;
+  long size;
+  int n = 0;
+  FILE *f;
+
+  *songs = NULL;
+  if (!prefFilePath(path, sizeof(path), LIBRARY_FILE) ||
+      (f = fopen(path, "rb")) == NULL)
+    return 0;
+  if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 12 &&
+      fseek(f, 0, SEEK_SET) == 0 && (data = malloc(size)) != NULL &&
+      fread(data, 1, size, f) != (size_t)size) {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+  if (data == NULL) return 0;
+
+  p = data;
+  end = data + size;
+  memcpy(&version, p + 4, 4);
+  memcpy(&count, p + 8, 4);
+  p += 12;
+  if (memcmp(data, LIBRARY_MAGIC, 4) != 0 || version != LIBRARY_VERSION ||
+      count > (uint32_t)(size/sizeof(libraryrecord)) ||
+      (*songs = calloc(count ? count : 1, sizeof(songinfo))) == NULL) {
+    free(data);
+    return 0;
+  }
+
+  for (; n<(int)count; n++) {
+    libraryrecord r;
+    songinfo *s = &(*songs)[n];
+
+    if ((size_t)(end - p) < sizeof(r)) break;
+    memcpy(&r, p, sizeof(r));
+    p += sizeof(r);
+    if (r.file_len >= SONG_FILE_LEN || r.mp3_len >= CHART_MP3_LEN ||
+        (size_t)(end - p) < (size_t)r.file_len + r.mp3_len)
+      break;
+    memcpy(s->file, p, r.file_len);
+    memcpy(s->mp3, p + r.file_len, r.mp3_len);
+    p += r.file_len + r.mp3_len;
+    s->mtime = r.mtime;
+    s->size = r.size;
+    s->length = r.length;
+    s->offset = r.offset;
+    s->num_notes = r.num_notes;
+    s->low = r.low;
+    s->high = r.high;
+    s->ok = r.ok;
+  }
+  free(data);
+
+  // Half a cache is as good as none: rescan the lot
+  if (n != (int)count) {
+    free(*songs);
+    *songs = NULL;
+    return 0;
+  }
+  return n;
+}
+
+
+/*=============< writeCache >==============*
+ * Save lib for next launch. Written next  *
+ * to the cache and renamed over it, so a  *
+ * crash never leaves half a file.         *
+ *=========================================*/
+static void writeCache(const library *lib) {
+  char path[1024], temp[1040];
+  uint32_t version = LIBRARY_VERSION, count = lib->num_songs;
+  int failed;
+  FILE *f;
+
+  if (!prefFilePath(path, sizeof(path), LIBRARY_FILE)) return;
+  snprintf(temp, sizeof(temp), "%s.new", path);
+  if ((f = fopen(temp, "wb")) == NULL) return;
+
+  fwrite(LIBRARY_MAGIC, 4, 1, f);
+  fwrite(&version, 4, 1, f);
+  fwrite(&count, 4, 1, f);
+  for (int i=0; i<lib->num_songs; i++) {
+    const songinfo *s = &lib->songs[i];
+    libraryrecord r;
+
+    memset(&r, 0, sizeof(r));
+    r.mtime = s->mtime;
+    r.size = s->size;
+    r.length = s->length;
+    r.offset = s->offset;
+    r.num_notes = s->num_notes;
+    r.low = s->low;
+    r.high = s->high;
+    r.ok = s->ok;
+    r.file_len = strlen(s->file);
+    r.mp3_len = strlen(s->mp3);
+    fwrite(&r, sizeof(r), 1, f);
+    fwrite(s->file, 1, r.file_len, f);
+    fwrite(s->mp3, 1, r.mp3_len, f);
+  }
+
+  failed = ferror(f) | fclose(f);
+  if (failed || rename(temp, path) != 0) {
+    printf("Error writing song library cache %s\n", path);
+    remove(temp);
+  }
+}
+
+
+/*=============< listCharts >==============*
+ * Name, mtime and size of every .tmn in   *
+ * dir into *songs, sorted by name.        *
+ * Returns how many, or -1 on failure.     *
+ *=========================================*/
+static int listCharts(const char *dir, songinfo **songs) {
+  char path[1024];
+  struct dirent *e;
+  struct stat st;
+  int n = 0, max = 0;
+  DIR *d = opendir(dir);
+
+  *songs = NULL;
+  if (d == NULL) {
+    printf("Error opening song directory %s\n", dir);
+    return -1;
+  }
+  while ((e = readdir(d)) != NULL) {
+    size_t len = strlen(e->d_name);
+
+    if (len < 5 || len >= SONG_FILE_LEN ||
+        strcmp(e->d_name + len - 4, ".tmn") != 0)
+      continue;
+    snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+      continue;
+
+    if (n == max) {
+      songinfo *grown;
+      max = max ? 2*max : 64;
+      grown = realloc(*songs, max*sizeof(songinfo));
+      if (grown == NULL) {
+        closedir(d);
+        free(*songs);
+        *songs = NULL;
+        printf("Out of memory listing %s\n", dir);
+        return -1;
+      }
+      *songs = grown;
+    }
+    memset(&(*songs)[n], 0, sizeof(songinfo));
+    memcpy((*songs)[n].file, e->d_name, len + 1);
+    (*songs)[n].mtime = st.st_mtime;
+    (*songs)[n].size = st.st_size;
+    n++;
+  }
+  closedir(d);
+
+  if (n > 0) qsort(*songs, n, sizeof(songinfo), compareSongs);
+  return n;
+}
+
+
+/*=============< readSong >==============*
+ * Load one chart and fill in what the   *
+ * library keeps about it.               *
+ *=======================================*/
+static void readSong(library *lib, int index) {
+  songinfo *s = &lib->songs[index];
+  char path[1024];
+  chart c;
+
+  s->ok = 0;
+  if (songPath(lib, index, path, sizeof(path)) || loadChart(&c, path, 1))
+    return;
+
+  memcpy(s->mp3, c.mp3, CHART_MP3_LEN);
+  s->offset = c.offset;
+  s->num_notes = c.notes.count;
+  s->length = 0;
+  for (int i=0; i<c.num_parts; i++) {
+    const notearena *n = &c.parts[i].notes;
+    if (n->count && n->end[n->count-1] > s->length)
+      s->length = n->end[n->count-1];
+  }
+  s->low = s->high = c.notes.count ? c.notes.pitch[0] : 0;
+  for (int i=1; i<c.notes.count; i++) {
+    if (c.notes.pitch[i] < s->low) s->low = c.notes.pitch[i];
+    if (c.notes.pitch[i] > s->high) s->high = c.notes.pitch[i];
+  }
+  s->ok = 1;
+  freeChart(&c);
+}
+
+
+/*=============< scanLoop >==============*
+ * Read charts off the job until none    *
+ * are left. Runs on every scan thread   *
+ * and the one that started them.        *
+ *=======================================*/
+static int scanLoop(void *data) {
+  scanjob *job = data;
+  int i;
+
+  while ((i = SDL_AtomicAdd(&job->next, 1)) < job->num_todo)
+    readSong(job->lib, job->todo[i]);
+  return 0;
+}
+
+
+/*===============< loadLibrary >================*
+ * Index every chart in dir. Unchanged charts   *
+ * come from the cache; new and changed ones    *
+ * are read in parallel, and the cache updated. *
+ * Returns 0 on success.                        *
+ *==============================================*/
+int loadLibrary(library *lib, const char *dir) {
+  SDL_Thread *threads[LIBRARY_THREADS];
+  songinfo *cached;
+  int num_cached, num_threads = 0;
+  scanjob job;
+
+  memset(lib, 0, sizeof(*lib));
+  lib->dir = dir;
+  lib->num_songs = listCharts(dir, &lib->songs);
+  if (lib->num_songs < 0) {
+    lib->num_songs = 0;
+    return 1;
+  }
+
+  job.lib = lib;
+  job.num_todo = 0;
+  job.todo = malloc((lib->num_songs ? lib->num_songs : 1)*sizeof(int));
+  if (job.todo == NULL) {
+    freeLibrary(lib);
+    return 1;
+  }
+  SDL_AtomicSet(&job.next, 0);
+
+  // Whatever hasn't changed on disk since last time is already known
+  num_cached = readCache(&cached);
+  for (int i=0; i<lib->num_songs; i++) {
+    songinfo *s = &lib->songs[i];
+    songinfo *old = num_cached ? bsearch(s, cached, num_cached,
+                                         sizeof(songinfo), compareSongs)
+                               : NULL;
+    if (old && old->mtime == s->mtime && old->size == s->size)
+      *s = *old;
+    else
+      job.todo[job.num_todo++] = i;
+  }
+  free(cached);
+
+  // The rest is spread over the cores; this thread takes a share too
+  if (job.num_todo > 1) {
+    num_threads = SDL_GetCPUCount() - 1;
+    if (num_threads > LIBRARY_THREADS - 1) num_threads = LIBRARY_THREADS - 1;
+    if (num_threads > job.num_todo - 1) num_threads = job.num_todo - 1;
+  }
+  for (int i=0; i<num_threads; i++) {
+    threads[i] = SDL_CreateThread(scanLoop, "library", &job);
+    if (threads[i] == NULL) {
+      num_threads = i;
+      break;
+    }
+  }
+  scanLoop(&job);
+  for (int i=0; i<num_threads; i++)
+    SDL_WaitThread(threads[i], NULL);
+
+  lib->rescanned = job.num_todo;
+  if (job.num_todo > 0 || num_cached != lib->num_songs)
+    writeCache(lib);
+  free(job.todo);
+  return 0;
+}
+
+
+/*===============< songPath >================*
+ * Where song index's chart is. Returns 0 on *
+ * success, 1 if it doesn't fit in path.     *
+ *===========================================*/
+int songPath(const library *lib, int index, char *path, size_t len) {
+  return snprintf(path, len, "%s/%s", lib->dir, lib->songs[index].file) >=
+         (int)len;
+}
+
+
+/*============< freeLibrary >=============*
+ * Everything loadLibrary allocated.      *
+ *========================================*/
+void freeLibrary(library *lib) {
+  free(lib->songs);
+  memset(lib, 0, sizeof(*lib));
+}
@@ -0,0 +1,41 @@
+/* Song Library */
+
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <stdint.h>
+
+#include "chart.h"
+
+#define LIBRARY_DIR      "songs"
+#define LIBRARY_FILE     "library.idx"  // In SDL's per-user pref path
+#define LIBRARY_MAGIC    "TMNL"
+#define LIBRARY_VERSION  1
+#define LIBRARY_THREADS  8              // Most charts read at once
+#define SONG_FILE_LEN    256
+
+/* What the song list needs to know about one chart, without loading it */
+typedef struct {
+  char file[SONG_FILE_LEN];   // Chart's name inside the library directory
+  char mp3[CHART_MP3_LEN];
+  double offset;
+  int64_t mtime;              // Chart file as it was when read
+  int64_t size;
+  int64_t length;             // Samples until the last note ends
+  int num_notes;
+  uint8_t low, high;          // Pitch range
+  uint8_t ok;                 // Loaded fine; 0 for broken charts
+} songinfo;
+
+typedef struct {
+  const char *dir;
+  songinfo *songs;            // Sorted by file name
+  int num_songs;
+  int rescanned;              // Charts read this time; the rest were cached
+} library;
+
+int loadLibrary(library *lib, const char *dir);
+int songPath(const library *lib, int index, char *path, size_t len);
+void freeLibrary(library *lib);
+
+#endif
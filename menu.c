@@ -0,0 +1,426 @@
+/*=======================*
+ |   Song Select Menu    |
+ *=======================*/
+
+/* The list of songs in the library, filtered as the player types.
+ *
+ * Searching: every song gets a lowercased key (chart name and MP3 name),
+ * and every three-letter run in a key is hashed into a bucket listing the
+ * songs that contain it. A query of three letters or more starts from the
+ * shortest bucket among its trigrams, and typing another letter starts
+ * from the last results if those are fewer, so only a handful of keys are
+ * ever checked with strstr, even in a library of thousands.
+ *
+ * Drawing: only the rows on screen exist as far as the renderer is
+ * concerned. Row labels are rasterized into slots of one label texture
+ * and reused, least recently used first, while they stay on screen. At
+ * most MENU_NEW_LABELS are rasterized a frame, so flinging through the
+ * list never drops a frame; rows still waiting show up a frame or two
+ * later. The whole menu is one texture and two draw calls.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <SDL2/SDL_ttf.h>
+
+#include "menu.h"
+#include "game.h"
+#include "hud.h"
+
+#define TRIGRAM_BUCKETS (1 << TRIGRAM_BITS)
+#define MENU_LABEL_WIDTH (WIDTH - 2*MENU_MARGIN - 16)
+
+/* One rasterized line of text in the label texture */
+typedef struct {
+  char text[MENU_LABEL_LEN];
+  int width;                  // Logical pixels
+  Uint64 last_used;           // Frame stamp for LRU eviction; 0 = empty
+} labelslot;
+
+static TTF_Font *label_font;
+static SDL_Texture *labels;   // MENU_LABELS slots stacked top to bottom
+static SDL_Surface *scratch;  // One slot's worth, to rasterize into
+static labelslot slots[MENU_LABELS];
+static float label_scale;
+static int slot_w, slot_h;    // Texture pixels
+static Uint64 label_frame;
+static int made_this_frame;
+
+
+static unsigned trigramBucket(const char *s) {
+  unsigned t = ((unsigned char)s[0] << 16) | ((unsigned char)s[1] << 8) |
+               (unsigned char)s[2];
+  return (t*2654435761u) >> (32 - TRIGRAM_BITS);
+}
+
+static void lowercase(char *dst, const char *src, size_t len) {
+  for (size_t i=0; i<len; i++)
+    dst[i] = ((unsigned char)src[i] < 128) ? tolower(src[i]) : src[i];
+  dst[len] = '\0';
+}
+
+
+/*===============< search >================*
+ * Redo m->matches for m->query. With      *
+ * narrowing, the query only got longer,   *
+ * so the old matches are a superset.      *
+ *=========================================*/
+static void search(songmenu *m, int narrowing) {
+  const int *from = narrowing ? m->matches : NULL;  // NULL: every song
+  int num_from = narrowing ? m->num_matches : m->lib->num_songs;
+  int len = strlen(m->query), n = 0;
+  int *swap;
+
+  // Any song with the query in it has all of its trigrams
+  for (int i=0; i+3 <= len; i++) {
+    unsigned b = trigramBucket(m->query + i);
+    if (m->bucket_at[b+1] - m->bucket_at[b] < num_from) {
+      from = m->postings + m->bucket_at[b];
+      num_from = m->bucket_at[b+1] - m->bucket_at[b];
+    }
+  }
+
+  for (int i=0; i<num_from; i++) {
+    int song = from ? from[i] : i;
+    if (strstr(m->keys + m->key_at[song], m->query))
+      m->scratch[n++] = song;
+  }
+  swap = m->matches;
+  m->matches = m->scratch;
+  m->scratch = swap;
+  m->num_matches = n;
+  m->top = m->selected = 0;
+}
+
+
+/*================< menuInit >=================*
+ * Build the search index over lib and match  *
+ * every song. lib must outlive the menu.     *
+ * Returns 0 on success.                      *
+ *============================================*/
+int menuInit(songmenu *m, const library *lib) {
+  int n = lib->num_songs;
+  size_t total = 0;
+  int *last;                  // Last song put in each bucket
+
+  memset(m, 0, sizeof(*m));
+  m->lib = lib;
+  for (int i=0; i<n; i++)
+    total += strlen(lib->songs[i].file) + strlen(lib->songs[i].mp3) + 2;
+
+  m->keys = malloc(total + 1);
+  m->key_at = malloc((n + 1)*sizeof(int));
+  m->bucket_at = calloc(TRIGRAM_BUCKETS + 1, sizeof(int));
+  m->postings = malloc((total + 1)*sizeof(int));
+  m->matches = malloc((n + 1)*sizeof(int));
+  m->scratch = malloc((n + 1)*sizeof(int));
+  last = malloc(TRIGRAM_BUCKETS*sizeof(int));
+  if (!m->keys || !m->key_at || !m->bucket_at || !m->postings ||
+      !m->matches || !m->scratch || !last) {
+    free(last);
+    menuFree(m);
+    return 1;
+  }
+
+  // Keys: "name.tmn mp3", lowercased, one after another
+  total = 0;
+  for (int i=0; i<n; i++) {
+    const songinfo *s = &lib->songs[i];
+    size_t file_len = strlen(s->file), mp3_len = strlen(s->mp3);
+
+    m->key_at[i] = total;
+    lowercase(m->keys + total, s->file, file_len);
+    m->keys[total + file_len] = ' ';
+    lowercase(m->keys + total + file_len + 1, s->mp3, mp3_len);
+    total += file_len + mp3_len + 2;
+  }
+
+  // Count each song once per bucket, then fill the buckets in song order
+  for (int pass=0; pass<2; pass++) {
+    for (int b=0; b<TRIGRAM_BUCKETS; b++)
+      last[b] = -1;
+    for (int i=0; i<n; i++) {
+      const char *key = m->keys + m->key_at[i];
+      for (int j=0; key[j] && key[j+1] && key[j+2]; j++) {
+        unsigned b = trigramBucket(key + j);
+        if (last[b] == i) continue;
+        last[b] = i;
+        if (pass == 0) m->bucket_at[b+1]++;
+        else m->postings[m->bucket_at[b]++] = i;
+      }
+    }
+    // Pass 0 leaves counts: make them starts. Pass 1 leaves each start
+    // moved to the next bucket's: move them back.
+    if (pass == 0) {
+      for (int b=0; b<TRIGRAM_BUCKETS; b++)
+        m->bucket_at[b+1] += m->bucket_at[b];
+    }
+    else {
+      memmove(m->bucket_at + 1, m->bucket_at, TRIGRAM_BUCKETS*sizeof(int));
+      m->bucket_at[0] = 0;
+    }
+  }
+  free(last);
+
+  search(m, 0);
+  return 0;
+}
+
+
+/*============< menuFree >=============*
+ * Everything menuInit allocated.      *
+ *=====================================*/
+void menuFree(songmenu *m) {
+  free(m->keys);
+  free(m->key_at);
+  free(m->bucket_at);
+  free(m->postings);
+  free(m->matches);
+  free(m->scratch);
+  memset(m, 0, sizeof(*m));
+}
+
+
+/*===============< menuType >================*
+ * Add typed text (from SDL_TEXTINPUT) to    *
+ * the query and narrow the matches.         *
+ *===========================================*/
+void menuType(songmenu *m, const char *text) {
+  size_t len = strlen(m->query), add = strlen(text);
+
+  if (add == 0 || len + add >= MENU_QUERY_LEN) return;
+  lowercase(m->query + len, text, add);
+  search(m, 1);
+}
+
+
+/*================< menuKey >=================*
+ * Move through the list, or take back typed *
+ * text (Escape takes back all of it). Enter *
+ * is the caller's.                          *
+ *============================================*/
+void menuKey(songmenu *m, SDL_Keycode key) {
+  int to = m->selected;
+  size_t len = strlen(m->query);
+
+  if (key == SDLK_ESCAPE && len > 0) {
+    m->query[0] = '\0';
+    search(m, 0);
+    return;
+  }
+  if (key == SDLK_BACKSPACE && len > 0) {
+    // A whole UTF-8 character, continuation bytes and all
+    while (len > 0 && ((unsigned char)m->query[--len] & 0xC0) == 0x80)
+      ;
+    m->query[len] = '\0';
+    search(m, 0);
+    return;
+  }
+  if (key == SDLK_UP) to--;
+  else if (key == SDLK_DOWN) to++;
+  else if (key == SDLK_PAGEUP) to -= MENU_ROWS;
+  else if (key == SDLK_PAGEDOWN) to += MENU_ROWS;
+  else if (key == SDLK_HOME) to = 0;
+  else if (key == SDLK_END) to = m->num_matches - 1;
+  else return;
+
+  if (to > m->num_matches - 1) to = m->num_matches - 1;
+  if (to < 0) to = 0;
+  m->selected = to;
+  if (m->selected < m->top) m->top = m->selected;
+  if (m->selected >= m->top + MENU_ROWS) m->top = m->selected - MENU_ROWS + 1;
+}
+
+
+/*=============< menuChoice >==============*
+ * Library index of the song under the     *
+ * cursor, or -1 if nothing matches.       *
+ *=========================================*/
+int menuChoice(const songmenu *m) {
+  return m->num_matches ? m->matches[m->selected] : -1;
+}
+
+
+/*==============< menuView >===============*
+ * Fill in what the renderer will need to  *
+ * show the menu as it is now.             *
+ *=========================================*/
+void menuView(const songmenu *m, menuview *v) {
+  v->active = 1;
+  v->lib = m->lib;
+  memcpy(v->query, m->query, MENU_QUERY_LEN);
+  v->num_matches = m->num_matches;
+  v->top = m->top;
+  v->selected = m->selected;
+  v->num_rows = m->num_matches - m->top;
+  if (v->num_rows > MENU_ROWS) v->num_rows = MENU_ROWS;
+  for (int r=0; r<v->num_rows; r++)
+    v->rows[r] = m->matches[m->top + r];
+}
+
+
+/*===============< menuLoad >================*
+ * Font and label texture, rasterized at     *
+ * scale. Render thread. Returns 0 on        *
+ * success.                                  *
+ *===========================================*/
+int menuLoad(SDL_Renderer *renderer, const char *fontpath, float scale) {
+  label_scale = scale;
+  slot_w = (int)ceilf(MENU_LABEL_WIDTH*scale);
+  slot_h = (int)ceilf(MENU_ROW_HEIGHT*scale);
+  memset(slots, 0, sizeof(slots));
+  label_frame = 0;
+
+  label_font = TTF_OpenFont(fontpath, (int)(MENU_FONT_SIZE*scale + 0.5f));
+  scratch = SDL_CreateRGBSurfaceWithFormat(0, slot_w, slot_h, 32,
+                                           SDL_PIXELFORMAT_RGBA32);
+  labels = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32,
+                             SDL_TEXTUREACCESS_STATIC, slot_w,
+                             slot_h*MENU_LABELS);
+  if (label_font == NULL || scratch == NULL || labels == NULL) {
+    menuUnload();
+    return 1;
+  }
+  SDL_SetTextureBlendMode(labels, SDL_BLENDMODE_BLEND);
+  perf.textures++;
+  perf.textures_created++;
+  return 0;
+}
+
+
+/*==============< findLabel >===============*
+ * Slot holding text, rasterizing it if     *
+ * this frame still has room for that.      *
+ * Returns -1 if it has to wait.            *
+ *==========================================*/
+static int findLabel(const char *text) {
+  SDL_Color white = {255, 255, 255, 255};
+  labelslot *victim = &slots[0];
+  SDL_Surface *line;
+  SDL_Rect to;
+
+  for (int i=0; i<MENU_LABELS; i++) {
+    if (slots[i].last_used && strcmp(slots[i].text, text) == 0) {
+      slots[i].last_used = label_frame;
+      perf.text_hits++;
+      return i;
+    }
+    if (slots[i].last_used < victim->last_used) victim = &slots[i];
+  }
+
+  // Miss: take the least recently used slot, unless it's on screen
+  if (made_this_frame >= MENU_NEW_LABELS || victim->last_used == label_frame)
+    return -1;
+  perf.text_misses++;
+  made_this_frame++;
+
+  SDL_FillRect(scratch, NULL, SDL_MapRGBA(scratch->format, 0, 0, 0, 0));
+  line = TTF_RenderUTF8_Blended(label_font, text, white);
+  victim->width = 0;
+  if (line) {
+    SDL_Rect at = {0, (slot_h - line->h)/2, line->w, line->h};
+    SDL_SetSurfaceBlendMode(line, SDL_BLENDMODE_NONE);
+    SDL_BlitSurface(line, NULL, scratch, &at);
+    victim->width = (int)((line->w < slot_w ? line->w : slot_w)/label_scale);
+    SDL_FreeSurface(line);
+  }
+  to = (SDL_Rect){0, (int)(victim - slots)*slot_h, slot_w, slot_h};
+  SDL_UpdateTexture(labels, &to, scratch->pixels, scratch->pitch);
+
+  snprintf(victim->text, MENU_LABEL_LEN, "%s", text);
+  victim->last_used = label_frame;
+  return victim - slots;
+}
+
+
+/*==============< queueLabel >===============*
+ * Text, left aligned at (x, y), one row     *
+ * tall. Nothing if it isn't rasterized yet. *
+ *===========================================*/
+static void queueLabel(renderqueue *q, const char *text, float x, float y) {
+  SDL_Color white = {255, 255, 255, 255};
+  int i = findLabel(text);
+  float w, v0, v1, u1;
+
+  if (i < 0) return;
+  w = slots[i].width;
+  u1 = w*label_scale/slot_w;
+  v0 = (float)i/MENU_LABELS;
+  v1 = (float)(i+1)/MENU_LABELS;
+  SDL_Vertex v[4] = {
+    {{x, y}, white, {0, v0}}, {{x + w, y}, white, {u1, v0}},
+    {{x + w, y + MENU_ROW_HEIGHT}, white, {u1, v1}},
+    {{x, y + MENU_ROW_HEIGHT}, white, {0, v1}}
+  };
+  queueQuads(q, LAYER_WORLD, labels, v, 1);
+}
+
+
+/*===============< menuDraw >================*
+ * Queue the search line, the rows on        *
+ * screen, the cursor and a scroll bar.      *
+ *===========================================*/
+void menuDraw(const menuview *v, renderqueue *q) {
+  SDL_Color bar = {0, 0, 0, 60};
+  SDL_Color cursor = {255, 140, 0, 200};
+  SDL_Color thumb = {0, 0, 0, 120};
+  char text[MENU_LABEL_LEN];
+  SDL_Rect r;
+
+  if (labels == NULL) return;
+  label_frame++;
+  made_this_frame = 0;
+
+  // The search line first, so it's never the one waiting a frame
+  snprintf(text, sizeof(text), "Find: %s_   %d song%s", v->query,
+           v->num_matches, v->num_matches == 1 ? "" : "s");
+  r = (SDL_Rect){MENU_MARGIN, MENU_TOP - MENU_ROW_HEIGHT - 12,
+                 WIDTH - 2*MENU_MARGIN, MENU_ROW_HEIGHT};
+  queueFill(q, LAYER_TEXT, &r, bar);
+  queueLabel(q, text, r.x + 8, r.y);
+
+  for (int row=0; row<v->num_rows; row++) {
+    const songinfo *s = &v->lib->songs[v->rows[row]];
+    int len = strlen(s->file) - 4;          // Without the .tmn
+    int seconds = (int)(s->length/TIMELINE_RATE);
+
+    r = (SDL_Rect){MENU_MARGIN, MENU_TOP + row*MENU_ROW_HEIGHT,
+                   WIDTH - 2*MENU_MARGIN, MENU_ROW_HEIGHT};
+    if (v->top + row == v->selected)
+      queueFill(q, LAYER_TEXT, &r, cursor);
+    if (s->ok)
+      snprintf(text, sizeof(text), "%.*s   %d:%02d", len, s->file,
+               seconds/60, seconds%60);
+    else
+      snprintf(text, sizeof(text), "%.*s   (broken)", len, s->file);
+    queueLabel(q, text, r.x + 8, r.y);
+  }
+
+  // Where in the list the rows are
+  if (v->num_matches > MENU_ROWS) {
+    int track = MENU_ROWS*MENU_ROW_HEIGHT;
+    r = (SDL_Rect){WIDTH - MENU_MARGIN + 4,
+                   MENU_TOP + (int)((double)v->top/v->num_matches*track), 6,
+                   (int)((double)MENU_ROWS/v->num_matches*track) + 4};
+    queueFill(q, LAYER_TEXT, &r, thumb);
+  }
+}
+
+
+/*==============< menuUnload >===============*
+ * Free what menuLoad made. Render thread.   *
+ *===========================================*/
+void menuUnload(void) {
+  if (labels) {
+    SDL_DestroyTexture(labels);
+    perf.textures--;
+  }
+  if (scratch) SDL_FreeSurface(scratch);
+  if (label_font) TTF_CloseFont(label_font);
+  labels = NULL;
+  scratch = NULL;
+  label_font = NULL;
+}
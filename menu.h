@@ -0,0 +1,60 @@
+/* Song Select Menu */
+
+#ifndef MENU_H
+#define MENU_H
+
+#include <SDL2/SDL.h>
+
+#include "library.h"
+#include "renderqueue.h"
+
+#define MENU_ROWS        14     // Song rows on screen at once
+#define MENU_ROW_HEIGHT  40
+#define MENU_TOP         150    // Screen y of the first row
+#define MENU_MARGIN      24     // Left and right of the rows
+#define MENU_FONT_SIZE   22
+#define MENU_QUERY_LEN   48
+#define MENU_LABEL_LEN   96     // Longest row text; the rest is cut off
+#define MENU_LABELS      (2*MENU_ROWS+2)   // Row textures kept rasterized
+#define MENU_NEW_LABELS  4      // Most rasterized per frame
+#define TRIGRAM_BITS     12     // Search index has 1 << this many buckets
+
+/* What the renderer needs to draw the menu: the rows on screen and no
+ * more, so a snapshot is the same size with 10 songs or 10000 */
+typedef struct {
+  int active;
+  const library *lib;         // Read-only while the menu is up
+  char query[MENU_QUERY_LEN];
+  int num_matches;
+  int top;                    // Match shown in the first row
+  int selected;               // Match under the cursor
+  int num_rows;
+  int rows[MENU_ROWS];        // Song index in each row
+} menuview;
+
+/* Logic side: the search index and the current results */
+typedef struct {
+  const library *lib;
+  char *keys;                 // Lowercased name and MP3 of every song
+  int *key_at;                // Where each song's key starts in keys
+  int *bucket_at;             // Where each trigram bucket starts in postings
+  int *postings;              // Songs with each trigram, in library order
+  int *matches;               // Songs matching query, in library order
+  int *scratch;
+  int num_matches;
+  char query[MENU_QUERY_LEN];
+  int top, selected;
+} songmenu;
+
+int menuInit(songmenu *m, const library *lib);
+void menuFree(songmenu *m);
+void menuType(songmenu *m, const char *text);
+void menuKey(songmenu *m, SDL_Keycode key);
+int menuChoice(const songmenu *m);
+void menuView(const songmenu *m, menuview *v);
+
+int menuLoad(SDL_Renderer *renderer, const char *fontpath, float scale);
+void menuDraw(const menuview *v, renderqueue *q);
+void menuUnload(void);
+
+#endif
@@ -0,0 +1,614 @@
+/*=======================*
+ |     MIDI Importer     |
+ *=======================*/
+
+/* Turns a Standard MIDI File into a chart. The file is read one event at
+ * a time, so nothing bigger than the notes themselves is ever held:
+ *
+ *   ./midiimport [-t track] [-c channel] [-b] song.mid [out]
+ *   ./midiimport [-t track] [-c channel] [-b] dir
+ *
+ * By default every track and every channel but drums (10) is used; -t and
+ * -c narrow that down. -b writes .tmnb instead of .tmn. Given a directory,
+ * every .mid in it is converted, spread over the cores, with each chart
+ * written next to its MIDI file.
+ *
+ * Theremins play one note at a time, so chords keep their top note and
+ * each note lasts until the next one starts. Notes outside C4..C5 are
+ * moved by octaves into it, and sharps round down to the white key below.
+ * Silence before the first note becomes the chart's offset, so the MP3
+ * (named after the MIDI file) can be the whole rendered song.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <SDL2/SDL.h>
+
+#include "chart.h"
+
+#define MIDI_THREADS 8
+#define DRUM_CHANNEL 9            // Channel 10, counting from 0
+#define DEFAULT_TEMPO 500000      // Microseconds per beat: 120 bpm
+
+/* The options that pick what gets imported */
+typedef struct {
+  int track;                      // -1 for all
+  int channel;                    // 0-15, or -1 for all but drums
+  int binary;                     // Write .tmnb rather than .tmn
+} importopts;
+
+/* A file being read, and how much of the current chunk is left */
+typedef struct {
+  FILE *f;
+  uint32_t left;
+  int err;                        // Ran off the end of the chunk or file
+} midireader;
+
+typedef struct {
+  uint32_t on, off;               // Ticks since the start of the song
+  uint8_t key;
+} midinote;
+
+typedef struct {
+  uint32_t tick;
+  uint32_t tempo;                 // Microseconds per beat from here on
+  double seconds;                 // When tick falls, filled in once sorted
+} tempochange;
+
+/* Everything collected from the file, grown as it's read */
+typedef struct {
+  midinote *notes;
+  int num_notes, max_notes;
+  tempochange *tempos;
+  int num_tempos, max_tempos;
+  int division;                   // Ticks per beat, or SMPTE if negative
+} midisong;
+
+/* Files left to convert, shared by the batch threads */
+typedef struct {
+  char **files;
+  int num_files;
+  const importopts *opts;
+  SDL_atomic_t next;              // Next file to hand out
+  SDL_atomic_t failed;            // How many didn't convert
+} importjob;
+
+/* White key (pitch index) for each semitone from C4 up to C5 */
+static const uint8_t semitonePitch[13] = {0,0,1,1,2,3,3,4,4,5,5,6,7};
+
+
+/*=============< readByte >==============*
+ * Next byte of the chunk, or 0 with err *
+ * set once the chunk is used up.        *
+ *=======================================*/
+static int readByte(midireader *r) {
+  int b;
+
+  if (r->left == 0) {
+    r->err = 1;
+    return 0;
+  }
+  b = getc(r->f);
+  if (b == EOF) {
+    r->err = 1;
+    return 0;
+  }
+  r->left--;
+  return b;
+}
+
+/* Big-endian, as everything in a MIDI file is */
+static uint32_t readBytes(midireader *r, int n) {
+  uint32_t v = 0;
+  while (n--) v = (v << 8) | readByte(r);
+  return v;
+}
+
+static uint32_t readVarLen(midireader *r) {
+  uint32_t v = 0;
+  int b, n = 0;
+
+  do {
+    b = readByte(r);
+    v = (v << 7) | (b & 0x7f);
+  } while ((b & 0x80) && ++n < 4 && !r->err);
+  if (b & 0x80) r->err = 1;
+  return v;
+}
+
+static void skipBytes(midireader *r, uint32_t n) {
+  if (n > r->left) {
+    r->err = 1;
+    n = r->left;
+  }
+  if (fseek(r->f, n, SEEK_CUR)) r->err = 1;
+  r->left -= n;
+}
+
+
+/*============< readChunkHeader >=============*
+ * Read the next chunk's ID and length, and   *
+ * point r at its body. Returns 0 on success. *
+ *============================================*/
+static int readChunkHeader(midireader *r, char id[4]) {
+  r->left = 8;
+  r->err = 0;
+  for (int i=0; i<4; i++)
+    id[i] = readByte(r);
+  r->left = readBytes(r, 4);
+  if (r->err) return 1;
+  return 0;
+}
+
+
+/*===========< addNote >============*
+ * Open a note at tick and return   *
+ * its index, or -1 out of memory.  *
+ *==================================*/
+static int addNote(midisong *s, uint32_t tick, int key) {
+  if (s->num_notes == s->max_notes) {
+    int max = s->max_notes ? 2*s->max_notes : 256;
+    midinote *grown = realloc(s->notes, max*sizeof(midinote));
+    if (grown == NULL) return -1;
+    s->notes = grown;
+    s->max_notes = max;
+  }
+  s->notes[s->num_notes].on = tick;
+  s->notes[s->num_notes].off = tick;
+  s->notes[s->num_notes].key = key;
+  return s->num_notes++;
+}
+
+static int addTempo(midisong *s, uint32_t tick, uint32_t tempo) {
+  if (s->num_tempos == s->max_tempos) {
+    int max = s->max_tempos ? 2*s->max_tempos : 16;
+    tempochange *grown = realloc(s->tempos, max*sizeof(tempochange));
+    if (grown == NULL) return 1;
+    s->tempos = grown;
+    s->max_tempos = max;
+  }
+  s->tempos[s->num_tempos].tick = tick;
+  s->tempos[s->num_tempos].tempo = tempo;
+  s->num_tempos++;
+  return 0;
+}
+
+
+/*===============< readTrack >================*
+ * Read one MTrk chunk. Tempo changes are     *
+ * always kept; notes only if they're on a    *
+ * track and channel opts picked. Notes still *
+ * held at the end stop there. Returns 0 on   *
+ * success.                                   *
+ *============================================*/
+static int readTrack(midireader *r, midisong *s, int track,
+                     const importopts *opts, const char *path) {
+  int open[16][128];              // Note each key is holding, or -1
+  int want = (opts->track < 0 || opts->track == track);
+  uint32_t tick = 0;
+  int status = 0;                 // For running status
+
+  memset(open, -1, sizeof(open));
+  while (r->left > 0 && !r->err) {
+    int b, ch, key, vel;
+
+    tick += readVarLen(r);
+    b = readByte(r);
+    if (b & 0x80) {
+      status = b;
+      if (b < 0xf0) b = readByte(r);
+    }
+    else if (status == 0) {
+      printf("%s: track %d: data byte with no status\n", path, track);
+      return 1;
+    }
+
+    // Meta event: only tempo and end of track matter
+    if (status == 0xff) {
+      int type = readByte(r);
+      uint32_t len = readVarLen(r);
+      status = 0;
+      if (type == 0x51 && len == 3) {
+        if (addTempo(s, tick, readBytes(r, 3))) {
+          printf("Out of memory reading %s\n", path);
+          return 1;
+        }
+      }
+      else if (type == 0x2f)
+        break;
+      else
+        skipBytes(r, len);
+      continue;
+    }
+    // Sysex: skipped whole
+    if (status == 0xf0 || status == 0xf7) {
+      skipBytes(r, readVarLen(r));
+      status = 0;
+      continue;
+    }
+    if (status > 0xf0) {
+      printf("%s: track %d: unexpected system message %02x\n",
+             path, track, status);
+      return 1;
+    }
+
+    ch = status & 0x0f;
+    switch (status & 0xf0) {
+    case 0x80:
+    case 0x90:
+      key = b & 0x7f;
+      vel = readByte(r);
+      if (!want || (opts->channel < 0 ? ch == DRUM_CHANNEL
+                                      : ch != opts->channel))
+        break;
+      // Note on again before off: the old one stops here
+      if (open[ch][key] >= 0) {
+        s->notes[open[ch][key]].off = tick;
+        open[ch][key] = -1;
+      }
+      if ((status & 0xf0) == 0x90 && vel > 0) {
+        open[ch][key] = addNote(s, tick, key);
+        if (open[ch][key] < 0) {
+          printf("Out of memory reading %s\n", path);
+          return 1;
+        }
+      }
+      break;
+    case 0xc0:
+    case 0xd0:
+      break;                      // One data byte, already read
+    default:
+      readByte(r);                // Two data bytes
+      break;
+    }
+  }
+  if (r->err) {
+    printf("%s: track %d: truncated\n", path, track);
+    return 1;
+  }
+
+  for (int ch=0; ch<16; ch++)
+    for (int key=0; key<128; key++)
+      if (open[ch][key] >= 0)
+        s->notes[open[ch][key]].off = tick;
+  skipBytes(r, r->left);          // Anything after end of track
+  return 0;
+}
+
+
+/*==============< readMidi >===============*
+ * Read the header and every track of the  *
+ * file at path. Returns 0 on success.     *
+ *=========================================*/
+static int readMidi(const char *path, const importopts *opts, midisong *s) {
+  midireader r;
+  char id[4];
+  int format, num_tracks, track = 0;
+
+  memset(s, 0, sizeof(*s));
+  r.f = fopen(path, "rb");
+  if (r.f == NULL) {
+    printf("Error opening %s\n", path);
+    return 1;
+  }
+
+  if (readChunkHeader(&r, id) || memcmp(id, "MThd", 4) || r.left < 6) {
+    printf("%s: not a MIDI file\n", path);
+    fclose(r.f);
+    return 1;
+  }
+  format = readBytes(&r, 2);
+  num_tracks = readBytes(&r, 2);
+  s->division = (int16_t)readBytes(&r, 2);
+  skipBytes(&r, r.left);
+  if (r.err || format > 2 || s->division == 0) {
+    printf("%s: bad MIDI header\n", path);
+    fclose(r.f);
+    return 1;
+  }
+
+  // Unknown chunk types are allowed, and skipped
+  while (track < num_tracks && !readChunkHeader(&r, id)) {
+    if (memcmp(id, "MTrk", 4) != 0) {
+      skipBytes(&r, r.left);
+      continue;
+    }
+    if (readTrack(&r, s, track, opts, path)) {
+      fclose(r.f);
+      return 1;
+    }
+    track++;
+  }
+  fclose(r.f);
+
+  if (track < num_tracks)
+    printf("%s: only %d of %d tracks found\n", path, track, num_tracks);
+  if (opts->track >= track) {
+    printf("%s: no track %d\n", path, opts->track);
+    return 1;
+  }
+  return 0;
+}
+
+
+/* By start, then highest first so chords keep their top note */
+static int compareNotes(const void *a, const void *b) {
+  const midinote *x = a, *y = b;
+  if (x->on != y->on) return (x->on > y->on) - (x->on < y->on);
+  return y->key - x->key;
+}
+
+
+/*=============< buildTempoMap >==============*
+ * Sort the tempo changes and work out when   *
+ * each one falls, so any tick can be turned  *
+ * into seconds with one search. Returns 0 on *
+ * success.                                   *
+ *============================================*/
+static int buildTempoMap(midisong *s) {
+  tempochange t;
+  double per_tick;
+
+  // Insertion sort: there are few, and ties must keep file order
+  for (int i=1; i<s->num_tempos; i++) {
+    int j = i;
+    t = s->tempos[i];
+    for (; j > 0 && s->tempos[j-1].tick > t.tick; j--)
+      s->tempos[j] = s->tempos[j-1];
+    s->tempos[j] = t;
+  }
+  if (s->num_tempos == 0 || s->tempos[0].tick > 0) {
+    if (addTempo(s, 0, DEFAULT_TEMPO)) return 1;
+    t = s->tempos[s->num_tempos-1];
+    memmove(s->tempos + 1, s->tempos,
+            (s->num_tempos - 1)*sizeof(tempochange));
+    s->tempos[0] = t;
+  }
+
+  s->tempos[0].seconds = 0;
+  for (int i=1; i<s->num_tempos; i++) {
+    per_tick = s->tempos[i-1].tempo/(1e6*s->division);
+    s->tempos[i].seconds = s->tempos[i-1].seconds +
+      (s->tempos[i].tick - s->tempos[i-1].tick)*per_tick;
+  }
+  return 0;
+}
+
+
+/*============< tickSeconds >=============*
+ * Seconds from the start of the song to  *
+ * tick, following the tempo map (or the  *
+ * fixed SMPTE frame rate).               *
+ *========================================*/
+static double tickSeconds(const midisong *s, uint32_t tick) {
+  int lo = 0, hi = s->num_tempos - 1;
+
+  if (s->division < 0) {
+    int fps = -(s->division >> 8);
+    int per_frame = s->division & 0xff;
+    return tick/((fps == 29 ? 29.97 : fps)*per_frame);
+  }
+
+  // Last change at or before tick; of several at once, the last read
+  while (lo < hi) {
+    int mid = (lo + hi + 1)/2;
+    if (s->tempos[mid].tick <= tick) lo = mid;
+    else hi = mid - 1;
+  }
+  return s->tempos[lo].seconds + (tick - s->tempos[lo].tick)*
+         (s->tempos[lo].tempo/(1e6*s->division));
+}
+
+
+/*============< foldPitch >=============*
+ * Pitch index for a MIDI key, moved by *
+ * octaves into C4 (60) to C5 (72).     *
+ *======================================*/
+static int foldPitch(int key) {
+  while (key < 60) key += 12;
+  while (key > 72) key -= 12;
+  return semitonePitch[key - 60];
+}
+
+
+/*=============< buildChart >==============*
+ * Turn the notes read into a single line  *
+ * of chart notes. Returns 0 on success.   *
+ *=========================================*/
+static int buildChart(midisong *s, chart *c, const char *path) {
+  notearena *n = &c->notes;
+  double first;
+  int kept = 0;
+
+  if (s->num_notes == 0) {
+    printf("%s: no notes on the chosen track and channel\n", path);
+    return 1;
+  }
+  qsort(s->notes, s->num_notes, sizeof(midinote), compareNotes);
+  if (buildTempoMap(s) || allocNotes(n, s->num_notes)) {
+    printf("Out of memory converting %s\n", path);
+    return 1;
+  }
+
+  first = tickSeconds(s, s->notes[0].on);
+  c->offset = first;
+  for (int i=0; i<s->num_notes; i++) {
+    int64_t start;
+
+    // Chords, or notes less than a sample apart: keep the first
+    if (i > 0 && s->notes[i].on == s->notes[i-1].on)
+      continue;
+    start = llround((tickSeconds(s, s->notes[i].on) - first)*TIMELINE_RATE);
+    if (kept > 0 && start <= n->start[kept-1])
+      continue;
+
+    // The note before lasts until this one; rests can't be charted
+    if (kept > 0) n->end[kept-1] = start;
+    n->start[kept] = start;
+    n->end[kept] = llround((tickSeconds(s, s->notes[i].off) - first)*
+                           TIMELINE_RATE);
+    if (n->end[kept] <= start) n->end[kept] = start + 1;
+    n->pitch[kept] = foldPitch(s->notes[i].key);
+    kept++;
+  }
+  n->count = kept;
+  addPart(c, DEFAULT_PART, 0, kept);
+  markSustains(n);
+  return 0;
+}
+
+
+/*=============< importMidi >==============*
+ * Convert the MIDI file at path to a      *
+ * chart at out (or next to path if out is *
+ * NULL). Returns 0 on success.            *
+ *=========================================*/
+static int importMidi(const char *path, const char *out,
+                      const importopts *opts) {
+  char out_path[1024];
+  midisong s;
+  chart c;
+  int status;
+
+  memset(&c, 0, sizeof(c));
+  status = readMidi(path, opts, &s) || buildChart(&s, &c, path);
+  free(s.notes);
+  free(s.tempos);
+  if (status) {
+    freeChart(&c);
+    return 1;
+  }
+
+  replaceExtension(c.mp3, sizeof(c.mp3), path, ".mp3", 0);
+  if (out == NULL) {
+    replaceExtension(out_path, sizeof(out_path), path,
+                     opts->binary ? ".tmnb" : ".tmn", 1);
+    out = out_path;
+  }
+  status = opts->binary ? saveChartBinary(&c, out) : saveChartText(&c, out);
+  if (status == 0)
+    printf("%s: %d notes -> %s\n", path, c.notes.count, out);
+  freeChart(&c);
+  return status;
+}
+
+
+/*=============< importLoop >==============*
+ * Convert files off the job until none    *
+ * are left. Runs on every batch thread    *
+ * and the one that started them.          *
+ *=========================================*/
+static int importLoop(void *data) {
+  importjob *job = data;
+  int i;
+
+  while ((i = SDL_AtomicAdd(&job->next, 1)) < job->num_files)
+    if (importMidi(job->files[i], NULL, job->opts))
+      SDL_AtomicAdd(&job->failed, 1);
+  return 0;
+}
+
+
+/*=============< importDirectory >==============*
+ * Convert every .mid and .midi file in dir     *
+ * across the cores. Returns 0 if all of them   *
+ * converted.                                   *
+ *==============================================*/
+static int importDirectory(const char *dir, const importopts *opts) {
+  SDL_Thread *threads[MIDI_THREADS];
+  struct dirent *e;
+  importjob job;
+  int max = 0, num_threads = 0;
+  DIR *d = opendir(dir);
+
+  if (d == NULL) {
+    printf("Error opening %s\n", dir);
+    return 1;
+  }
+  memset(&job, 0, sizeof(job));
+  job.opts = opts;
+  while ((e = readdir(d)) != NULL) {
+    const char *dot = strrchr(e->d_name, '.');
+    size_t len;
+
+    if (dot == NULL || (strcasecmp(dot, ".mid") && strcasecmp(dot, ".midi")))
+      continue;
+    if (job.num_files == max) {
+      char **grown;
+      max = max ? 2*max : 64;
+      grown = realloc(job.files, max*sizeof(char*));
+      if (grown == NULL) break;
+      job.files = grown;
+    }
+    len = strlen(dir) + strlen(e->d_name) + 2;
+    job.files[job.num_files] = malloc(len);
+    if (job.files[job.num_files] == NULL) break;
+    snprintf(job.files[job.num_files++], len, "%s/%s", dir, e->d_name);
+  }
+  closedir(d);
+  if (e != NULL) {
+    printf("Out of memory listing %s\n", dir);
+    SDL_AtomicSet(&job.failed, 1);
+    job.num_files = 0;
+  }
+
+  // This thread takes a share too
+  SDL_AtomicSet(&job.next, 0);
+  num_threads = SDL_GetCPUCount() - 1;
+  if (num_threads > MIDI_THREADS) num_threads = MIDI_THREADS;
+  if (num_threads > job.num_files - 1) num_threads = job.num_files - 1;
+  for (int i=0; i<num_threads; i++) {
+    threads[i] = SDL_CreateThread(importLoop, "midiimport", &job);
+    if (threads[i] == NULL) {
+      num_threads = i;
+      break;
+    }
+  }
+  importLoop(&job);
+  for (int i=0; i<num_threads; i++)
+    SDL_WaitThread(threads[i], NULL);
+
+  if (job.num_files == 0 && e == NULL)
+    printf("No MIDI files in %s\n", dir);
+  for (int i=0; i<job.num_files; i++)
+    free(job.files[i]);
+  free(job.files);
+  return SDL_AtomicGet(&job.failed) > 0;
+}
+
+
+int main(int argc, char* argv[]) {
+  importopts opts = {-1, -1, 0};
+  struct stat st;
+  int i;
+
+  for (i=1; i<argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "-b") == 0)
+      opts.binary = 1;
+    else if (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+      opts.track = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-c") == 0 && i+1 < argc) {
+      opts.channel = atoi(argv[++i]) - 1;
+      if (opts.channel < 0 || opts.channel > 15) {
+        printf("Channel must be 1-16\n");
+        return 1;
+      }
+    }
+    else
+      break;
+  }
+  if (i == argc || argc - i > 2) {
+    printf("usage: %s [-t track] [-c channel] [-b] in.mid [out]\n"
+           "       %s [-t track] [-c channel] [-b] dir\n", argv[0], argv[0]);
+    return 1;
+  }
+
+  if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+    return importDirectory(argv[i], &opts);
+  return importMidi(argv[i], argc - i == 2 ? argv[i+1] : NULL, &opts);
+}
@@ -0,0 +1,112 @@
+/*=======================*
+ |   Particle Effects    |
+ *=======================*/
+
+/* Fixed-capacity particle pool for hit/miss effects. Nothing is allocated
+ * per particle: spawning writes into the next free slot, dying swaps the
+ * last live particle into the hole. Drawing appends to the sprite batch,
+ * so every particle goes out in the same SDL_RenderGeometry as the notes.
+ */
+
+#include <math.h>
+
+#include "particles.h"
+
+#ifndef M_PI
+  #define M_PI 3.1415926535897932384
+#endif
+
+#define GRAVITY 0.15f         // Pixels/frame^2
+#define PARTICLE_SIZE 8.0f
+
+particlepool particles;
+
+static Uint32 rng_state = 0x9e3779b9;
+
+
+/*====< randf >=====*
+ * xorshift, [0, 1) *
+ *==================*/
+static float randf(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return (rng_state >> 8)*(1.0f/16777216.0f);
+}
+
+
+/*===============< emitParticles >================*
+ * Spray count particles out of (x, y) at up to   *
+ * speed pixels/frame. Extra ones are dropped     *
+ * when the pool is full.                         *
+ *================================================*/
+void emitParticles(particlepool *p, float x, float y, int count,
+                   SDL_Color color, float speed) {
+  if (count > MAX_PARTICLES - p->count) count = MAX_PARTICLES - p->count;
+
+  for (int i=p->count; i<p->count+count; i++) {
+    float angle = randf()*(float)M_PI;          // Upper half only
+    float v = speed*(0.3f + 0.7f*randf());
+    float span = 20 + 25*randf();
+    p->x[i] = x;
+    p->y[i] = y;
+    p->vx[i] = cosf(angle)*v;
+    p->vy[i] = -sinf(angle)*v;
+    p->life[i] = span;
+    p->inv_span[i] = 1.0f/span;
+    p->r[i] = color.r;
+    p->g[i] = color.g;
+    p->b[i] = color.b;
+  }
+  p->count += count;
+}
+
+
+/*===============< updateParticles >================*
+ * Advance every particle by dt frames, then sweep  *
+ * out the dead ones.                               *
+ *==================================================*/
+void updateParticles(particlepool *p, float dt) {
+  float *restrict x = p->x, *restrict y = p->y;
+  float *restrict vx = p->vx, *restrict vy = p->vy;
+  float *restrict life = p->life;
+  int n = p->count;
+
+  // Branch-free so the compiler can vectorize it
+  for (int i=0; i<n; i++) {
+    x[i] += vx[i]*dt;
+    y[i] += vy[i]*dt;
+    vy[i] += GRAVITY*dt;
+    life[i] -= dt;
+  }
+
+  // Swap-remove; the new order only changes which overlapping spark is on top
+  for (int i=0; i<n; ) {
+    if (life[i] > 0) {
+      i++;
+      continue;
+    }
+    n--;
+    x[i] = x[n];   y[i] = y[n];
+    vx[i] = vx[n]; vy[i] = vy[n];
+    life[i] = life[n];
+    p->inv_span[i] = p->inv_span[n];
+    p->r[i] = p->r[n]; p->g[i] = p->g[n]; p->b[i] = p->b[n];
+  }
+  p->count = n;
+}
+
+
+/*===============< drawParticles >================*
+ * Queue every live particle as a fading dot.     *
+ *================================================*/
+void drawParticles(const particlepool *p, spritebatch *b, const atlas *a) {
+  const float half = PARTICLE_SIZE/2;
+
+  for (int i=0; i<p->count; i++) {
+    SDL_Color c = {p->r[i], p->g[i], p->b[i],
+                   (Uint8)(255*p->life[i]*p->inv_span[i])};
+    batchSprite(b, a, SPRITE_PARTICLE, p->x[i]-half, p->y[i]-half,
+                PARTICLE_SIZE, PARTICLE_SIZE, c);
+  }
+}
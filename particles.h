@@ -0,0 +1,36 @@
+/* Particle Effects */
+
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <SDL2/SDL.h>
+
+#include "atlas.h"
+
+#define MAX_PARTICLES 8192
+#define HIT_PARTICLES 48      // Spawned per hit note
+#define MISS_PARTICLES 16     // Spawned per missed note
+
+/* Structure of arrays: the update loop streams through each field on its
+ * own and vectorizes. Live particles are always packed at [0, count). */
+typedef struct {
+  int count;
+  float x[MAX_PARTICLES];
+  float y[MAX_PARTICLES];
+  float vx[MAX_PARTICLES];
+  float vy[MAX_PARTICLES];
+  float life[MAX_PARTICLES];      // Frames left
+  float inv_span[MAX_PARTICLES];  // 1/starting life, for fading
+  Uint8 r[MAX_PARTICLES];
+  Uint8 g[MAX_PARTICLES];
+  Uint8 b[MAX_PARTICLES];
+} particlepool;
+
+extern particlepool particles;
+
+void emitParticles(particlepool *p, float x, float y, int count,
+                   SDL_Color color, float speed);
+void updateParticles(particlepool *p, float dt);
+void drawParticles(const particlepool *p, spritebatch *b, const atlas *a);
+
+#endif
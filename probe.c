@@ -0,0 +1,128 @@
+/*=======================*
+ |  Render Driver Probe  |
+ *=======================*/
+
+/* SDL_CreateRenderer(window, -1, 0) takes whichever driver SDL lists
+ * first, which on some of our machines is a slow one. On first launch we
+ * run the real draw workload on every driver and remember the fastest
+ * one that can vsync. Later launches read the cached name and go
+ * straight to it.
+ *
+ *   ./theremin --reprobe         (forget the cached choice)
+ *   SDL_RENDER_DRIVER=<name>     (skip all this and use that driver)
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "probe.h"
+#include "game.h"
+#include "bench.h"
+
+
+/*==========< findDriver >===========*
+ * Index of the named driver, or -1. *
+ *===================================*/
+static int findDriver(const char *name, SDL_RendererInfo *info) {
+  for (int i=0; i<SDL_GetNumRenderDrivers(); i++) {
+    if (SDL_GetRenderDriverInfo(i, info) == 0 && strcmp(info->name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+
+/*=============< readCache >==============*
+ * Driver name from the cache file into   *
+ * name. Returns 1 if there was one.      *
+ *========================================*/
+static int readCache(char *name, size_t len) {
+  char path[1024], line[128];
+  int found = 0;
+  FILE *f;
+
+  if (!prefFilePath(path, sizeof(path), PROBE_FILE) ||
+      (f = fopen(path, "r")) == NULL)
+    return 0;
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, "driver=", 7) == 0) {
+      line[strcspn(line, "\r\n")] = '\0';
+      snprintf(name, len, "%s", line+7);
+      found = 1;
+    }
+  }
+  fclose(f);
+  return found;
+}
+
+
+static void writeCache(const char *name, double fps) {
+  char path[1024];
+  FILE *f;
+
+  if (!prefFilePath(path, sizeof(path), PROBE_FILE) ||
+      (f = fopen(path, "w")) == NULL)
+    return;
+  fprintf(f, "# Render driver picked by benchmark; delete to re-probe\n");
+  fprintf(f, "driver=%s\n", name);
+  fprintf(f, "fps=%.1f\n", fps);
+  fclose(f);
+}
+
+
+/*=============< pickRenderDriver >==============*
+ * Driver index to pass to SDL_CreateRenderer,   *
+ * with the flags to use in *flags. Benchmarks   *
+ * every driver when there's no usable cached    *
+ * choice (or reprobe is set). Must run on the   *
+ * thread that will own the renderer.            *
+ *===============================================*/
+int pickRenderDriver(SDL_Window *window, int reprobe, Uint32 *flags) {
+  SDL_RendererInfo info;
+  char name[64];
+  int best = -1, best_vsync = 0;
+  double best_fps = 0;
+
+  // An explicit choice from the user wins
+  *flags = SDL_RENDERER_PRESENTVSYNC;
+  if (SDL_getenv("SDL_RENDER_DRIVER"))
+    return -1;
+
+  if (!reprobe && readCache(name, sizeof(name))) {
+    int index = findDriver(name, &info);
+    if (index >= 0) {
+      *flags = (info.flags & SDL_RENDERER_PRESENTVSYNC);
+      return index;
+    }
+  }
+
+  // Fastest driver wins, but any vsync-capable one beats one without
+  for (int i=0; i<SDL_GetNumRenderDrivers(); i++) {
+    int vsync;
+    double fps;
+
+    if (SDL_GetRenderDriverInfo(i, &info) != 0) continue;
+    vsync = (info.flags & SDL_RENDERER_PRESENTVSYNC) != 0;
+    fps = benchmarkDriver(window, i, PROBE_FRAMES);
+    printf("probe: %-12s %8.1f fps%s\n", info.name, fps,
+           vsync ? "" : " (no vsync)");
+    if (fps <= 0) continue;
+
+    if (best < 0 || (vsync && !best_vsync) ||
+        (vsync == best_vsync && fps > best_fps)) {
+      best = i;
+      best_vsync = vsync;
+      best_fps = fps;
+    }
+  }
+
+  if (best < 0) {
+    *flags = 0;
+    return -1;              // Nothing worked; let SDL pick
+  }
+  SDL_GetRenderDriverInfo(best, &info);
+  writeCache(info.name, best_fps);
+  printf("probe: using %s\n", info.name);
+  *flags = best_vsync ? SDL_RENDERER_PRESENTVSYNC : 0;
+  return best;
+}
@@ -0,0 +1,13 @@
+/* Render Driver Probe */
+
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <SDL2/SDL.h>
+
+#define PROBE_FRAMES 120              // Benchmark length per driver
+#define PROBE_FILE "renderer.cfg"     // In SDL's per-user pref path
+
+int pickRenderDriver(SDL_Window *window, int reprobe, Uint32 *flags);
+
+#endif
@@ -0,0 +1,266 @@
+/*=======================*
+ |      Hot Reload       |
+ *=======================*/
+
+/* Watches the chart being played and the sprite overrides in assets/ with
+ * inotify, so authors see an edit without restarting. A thread sleeps on
+ * the inotify descriptor. When the chart is saved it parses it again right
+ * there and leaves the result for the game, which swaps it in between
+ * simulation steps without moving the song clock. A chart that doesn't
+ * parse is reported and the old one keeps playing. Sprite changes just
+ * raise a flag; the render thread owns the textures, so it rebuilds them.
+ *
+ * Directories are watched rather than files, as most editors save by
+ * writing a new file and renaming it over the old one.
+ *
+ * inotify is Linux only. Elsewhere this all does nothing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reload.h"
+
+#ifdef __linux__
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+#define CHART_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+#define ASSET_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)
+
+
+/*=============< isChartFile >==============*
+ * Is name the chart being played, or its   *
+ * compiled .tmnb? Call with r->lock held.  *
+ *==========================================*/
+static int isChartFile(const hotreload *r, const char *name) {
+  size_t len = strlen(r->chart_name);
+
+  if (len == 0 || strncmp(name, r->chart_name, len) != 0)
+    return 0;
+  return name[len] == '\0' || strcmp(name + len, "b") == 0;
+}
+
+static int isSprite(const char *name) {
+  size_t len = strlen(name);
+  return len > 4 && strcmp(name + len - 4, ".bmp") == 0;
+}
+
+
+/*=============< reloadChart >==============*
+ * Parse the chart at path again and leave  *
+ * it for takeReload, replacing any the     *
+ * game hasn't taken yet.                   *
+ *==========================================*/
+static void reloadChart(hotreload *r, const char *path, int generation) {
+  Uint64 start = SDL_GetPerformanceCounter();
+  reloadedchart *fresh = malloc(sizeof(reloadedchart));
+
+  if (fresh == NULL) return;
+  if (loadChart(&fresh->song, path, 1)) {
+    printf("Keeping the chart that was playing\n");
+    free(fresh);
+    return;
+  }
+  fresh->generation = generation;
+  printf("Reloaded %s: %d notes in %.1f ms\n", path, fresh->song.notes.count,
+         (SDL_GetPerformanceCounter() - start)*1000.0/
+         SDL_GetPerformanceFrequency());
+  freeReload(SDL_AtomicSetPtr(&r->ready, fresh));
+}
+
+
+/*=============< reloadLoop >==============*
+ * Wait for changes until told to quit.    *
+ * Every event waiting is read before      *
+ * acting, so a save that touches the file *
+ * more than once reloads it once.         *
+ *=========================================*/
+static int reloadLoop(void *data) {
+  hotreload *r = data;
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  char path[2*RELOAD_PATH_LEN];
+  struct pollfd pfd;
+  ssize_t len;
+
+  pfd.fd = r->fd;
+  pfd.events = POLLIN;
+  while (!SDL_AtomicGet(&r->quit)) {
+    int chart_changed = 0, generation = 0;
+
+    // Wake up now and then to check for quit
+    if (poll(&pfd, 1, 100) <= 0) continue;
+
+    while ((len = read(r->fd, buf, sizeof(buf))) > 0) {
+      for (char *p = buf; p < buf + len; ) {
+        const struct inotify_event *e = (const struct inotify_event*)p;
+        p += sizeof(struct inotify_event) + e->len;
+        if (e->len == 0) continue;
+
+        if (e->wd == r->assets_wd && isSprite(e->name))
+          SDL_AtomicSet(&r->assets_changed, 1);
+        SDL_LockMutex(r->lock);
+        if (e->wd == r->chart_wd && isChartFile(r, e->name)) {
+          snprintf(path, sizeof(path), "%s/%s", r->chart_dir, r->chart_name);
+          generation = r->generation;
+          chart_changed = 1;
+        }
+        SDL_UnlockMutex(r->lock);
+      }
+    }
+    if (chart_changed)
+      reloadChart(r, path, generation);
+  }
+  return 0;
+}
+
+
+/*=============< startReload >==============*
+ * Start watching ASSET_DIR, and whatever   *
+ * watchChart names later. Returns 0 on     *
+ * success.                                 *
+ *==========================================*/
+int startReload(hotreload *r) {
+  memset(r, 0, sizeof(*r));
+  r->assets_wd = r->chart_wd = -1;
+  r->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (r->fd < 0) {
+    printf("Hot reload off: no inotify\n");
+    return 1;
+  }
+  r->lock = SDL_CreateMutex();
+  if (r->lock == NULL) {
+    close(r->fd);
+    r->fd = -1;
+    return 1;
+  }
+  // No assets/ is fine: every sprite is generated then
+  r->assets_wd = inotify_add_watch(r->fd, ASSET_DIR, ASSET_EVENTS);
+
+  r->thread = SDL_CreateThread(reloadLoop, "reload", r);
+  if (r->thread == NULL) {
+    stopReload(r);
+    return 1;
+  }
+  return 0;
+}
+
+
+/*===============< watchChart >================*
+ * Make path the chart to reload when it       *
+ * changes; NULL watches no chart. Reloads of  *
+ * the chart before are dropped.               *
+ *=============================================*/
+void watchChart(hotreload *r, const char *path) {
+  const char *slash = path ? strrchr(path, '/') : NULL;
+  int old_wd, wd = -1;
+
+  if (r->fd < 0) return;
+  SDL_LockMutex(r->lock);
+  r->generation++;
+  r->chart_name[0] = '\0';
+  if (path) {
+    if (slash)
+      snprintf(r->chart_dir, RELOAD_PATH_LEN, "%.*s",
+               (int)(slash - path), path);
+    else
+      snprintf(r->chart_dir, RELOAD_PATH_LEN, ".");
+    snprintf(r->chart_name, RELOAD_PATH_LEN, "%s", slash ? slash + 1 : path);
+    // Add to the mask rather than replace it, in case this is ASSET_DIR
+    wd = inotify_add_watch(r->fd, r->chart_dir, CHART_EVENTS | IN_MASK_ADD);
+  }
+
+  // The same directory gets the same watch back; only drop a different one
+  old_wd = r->chart_wd;
+  r->chart_wd = wd;
+  if (old_wd >= 0 && old_wd != wd && old_wd != r->assets_wd)
+    inotify_rm_watch(r->fd, old_wd);
+  SDL_UnlockMutex(r->lock);
+}
+
+
+/*===============< takeReload >================*
+ * The chart watched, parsed again since it    *
+ * last changed, or NULL if it hasn't. Free it *
+ * with freeReload once done with it.          *
+ *=============================================*/
+reloadedchart *takeReload(hotreload *r) {
+  reloadedchart *fresh;
+  int current;
+
+  if (r->fd < 0 || SDL_AtomicGetPtr(&r->ready) == NULL) return NULL;
+  fresh = SDL_AtomicSetPtr(&r->ready, NULL);
+  SDL_LockMutex(r->lock);
+  current = r->generation;
+  SDL_UnlockMutex(r->lock);
+
+  // Read just before a different song was picked
+  if (fresh && fresh->generation != current) {
+    freeReload(fresh);
+    return NULL;
+  }
+  return fresh;
+}
+
+
+/* Did a sprite change since the last time this was asked? */
+int assetsChanged(hotreload *r) {
+  return r->fd >= 0 && SDL_AtomicSet(&r->assets_changed, 0);
+}
+
+
+/*==============< stopReload >===============*
+ * Stop watching, and drop any chart that    *
+ * was never taken.                          *
+ *===========================================*/
+void stopReload(hotreload *r) {
+  if (r->fd < 0) return;
+  SDL_AtomicSet(&r->quit, 1);
+  if (r->thread) SDL_WaitThread(r->thread, NULL);
+  r->thread = NULL;
+  freeReload(SDL_AtomicSetPtr(&r->ready, NULL));
+  close(r->fd);
+  r->fd = -1;
+  SDL_DestroyMutex(r->lock);
+  r->lock = NULL;
+}
+
+#else
+
+int startReload(hotreload *r) {
+  memset(r, 0, sizeof(*r));
+  r->fd = -1;
+  return 1;
+}
+
+void watchChart(hotreload *r, const char *path) {
+  (void)r;
+  (void)path;
+}
+
+reloadedchart *takeReload(hotreload *r) {
+  (void)r;
+  return NULL;
+}
+
+int assetsChanged(hotreload *r) {
+  (void)r;
+  return 0;
+}
+
+void stopReload(hotreload *r) {
+  (void)r;
+}
+
+#endif
+
+
+/* A chart from takeReload, and everything in it */
+void freeReload(reloadedchart *fresh) {
+  if (fresh == NULL) return;
+  freeChart(&fresh->song);
+  free(fresh);
+}
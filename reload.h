@@ -0,0 +1,43 @@
+/* Hot Reload */
+
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include <SDL2/SDL.h>
+
+#include "chart.h"
+
+#define ASSET_DIR "assets"
+#define RELOAD_PATH_LEN 1024
+
+/* A chart read again after it changed on disk */
+typedef struct {
+  chart song;
+  int generation;               // Which watchChart it belongs to
+} reloadedchart;
+
+typedef struct {
+  int fd;                       // inotify, or -1 when not watching
+  int assets_wd;                // Watch on ASSET_DIR, or -1
+
+  // The chart being played; everything below lock is guarded by it
+  SDL_mutex *lock;
+  char chart_dir[RELOAD_PATH_LEN];
+  char chart_name[RELOAD_PATH_LEN];     // Empty when there's no chart
+  int chart_wd;                         // Watch on chart_dir, or -1
+  int generation;                       // Bumped by every watchChart
+
+  SDL_Thread *thread;
+  SDL_atomic_t quit;
+  void *ready;                  // reloadedchart* waiting for the game
+  SDL_atomic_t assets_changed;  // Sprites changed since the renderer looked
+} hotreload;
+
+int startReload(hotreload *r);
+void watchChart(hotreload *r, const char *path);
+reloadedchart *takeReload(hotreload *r);
+void freeReload(reloadedchart *fresh);
+int assetsChanged(hotreload *r);
+void stopReload(hotreload *r);
+
+#endif
@@ -0,0 +1,238 @@
+/*=======================*
+ |     Render Queue      |
+ *=======================*/
+
+/* Everything a frame draws past the clear goes through here as quads:
+ * sprite batches, glyph batches, text textures and flat fills. Nothing
+ * touches the renderer until the queue is drawn. Then the commands are
+ * sorted by layer and texture, and each run of the same texture in a
+ * layer goes out as one SDL_RenderGeometry, whatever order the code
+ * submitted it in. Colors ride on the vertices, so there are no draw
+ * color changes either. A new panel or label adds quads to an existing
+ * run, not draw calls.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "renderqueue.h"
+#include "hud.h"
+
+
+/*============< reserveQuads >=============*
+ * Room for n more quads. 0 on success.    *
+ *=========================================*/
+static int reserveQuads(renderqueue *q, int n) {
+  int max = q->max_quads ? q->max_quads : 256;
+  SDL_Vertex *verts, *sorted;
+  int *indices;
+
+  if (q->num_quads + n <= q->max_quads) return 0;
+  while (max < q->num_quads + n) max *= 2;
+
+  verts = realloc(q->verts, max*4*sizeof(SDL_Vertex));
+  if (verts) q->verts = verts;
+  sorted = verts ? realloc(q->sorted, max*4*sizeof(SDL_Vertex)) : NULL;
+  if (sorted) q->sorted = sorted;
+  indices = sorted ? realloc(q->indices, max*6*sizeof(int)) : NULL;
+  if (indices == NULL) return 1;
+  q->indices = indices;
+
+  // Every run is drawn from its own base, so the pattern never changes
+  for (int i=q->max_quads; i<max; i++) {
+    int *idx = &indices[i*6];
+    idx[0] = i*4;   idx[1] = i*4+1; idx[2] = i*4+2;
+    idx[3] = i*4;   idx[4] = i*4+2; idx[5] = i*4+3;
+  }
+  q->max_quads = max;
+  return 0;
+}
+
+
+/*================< queueQuads >=================*
+ * Copy num_quads quads (4 verts each, corners   *
+ * clockwise from top left) into layer.          *
+ *===============================================*/
+void queueQuads(renderqueue *q, int layer, SDL_Texture *texture,
+                const SDL_Vertex *verts, int num_quads) {
+  drawcommand *c;
+
+  if (num_quads <= 0 || reserveQuads(q, num_quads)) return;
+  if (q->num_commands == q->max_commands) {
+    int max = q->max_commands ? q->max_commands*2 : 32;
+    drawcommand *commands = realloc(q->commands, max*sizeof(drawcommand));
+    if (commands == NULL) return;
+    q->commands = commands;
+    q->max_commands = max;
+  }
+
+  memcpy(&q->verts[q->num_quads*4], verts, num_quads*4*sizeof(SDL_Vertex));
+  c = &q->commands[q->num_commands];
+  c->layer = layer;
+  c->texture = texture;
+  c->seq = q->num_commands++;
+  c->first = q->num_quads;
+  c->count = num_quads;
+  q->num_quads += num_quads;
+  q->is_sorted = 0;
+}
+
+
+/*==============< queueBatch >===============*
+ * Hand over everything in b (drawn from     *
+ * texture) and empty it.                    *
+ *===========================================*/
+void queueBatch(renderqueue *q, int layer, spritebatch *b,
+                SDL_Texture *texture) {
+  queueQuads(q, layer, texture, b->verts, b->num_quads);
+  b->num_quads = 0;
+}
+
+
+/*=============< queueTexture >==============*
+ * All of texture stretched over dst.        *
+ *===========================================*/
+void queueTexture(renderqueue *q, int layer, SDL_Texture *texture,
+                  const SDL_Rect *dst) {
+  SDL_Color white = {255, 255, 255, 255};
+  float x0 = dst->x, y0 = dst->y, x1 = dst->x + dst->w, y1 = dst->y + dst->h;
+  SDL_Vertex v[4] = {
+    {{x0, y0}, white, {0, 0}}, {{x1, y0}, white, {1, 0}},
+    {{x1, y1}, white, {1, 1}}, {{x0, y1}, white, {0, 1}}
+  };
+
+  if (texture) queueQuads(q, layer, texture, v, 1);
+}
+
+
+/*==============< queueFill >================*
+ * Flat rectangle; alpha blends.             *
+ *===========================================*/
+void queueFill(renderqueue *q, int layer, const SDL_Rect *r, SDL_Color color) {
+  float x0 = r->x, y0 = r->y, x1 = r->x + r->w, y1 = r->y + r->h;
+  SDL_Vertex v[4] = {
+    {{x0, y0}, color, {0, 0}}, {{x1, y0}, color, {0, 0}},
+    {{x1, y1}, color, {0, 0}}, {{x0, y1}, color, {0, 0}}
+  };
+  queueQuads(q, layer, NULL, v, 1);
+}
+
+
+static int compareCommands(const void *a, const void *b) {
+  const drawcommand *ca = a, *cb = b;
+  uintptr_t ta = (uintptr_t)ca->texture, tb = (uintptr_t)cb->texture;
+
+  if (ca->layer != cb->layer) return ca->layer - cb->layer;
+  if (ta != tb) return (ta > tb) - (ta < tb);
+  return ca->seq - cb->seq;
+}
+
+
+/*==========< sortQueue >===========*
+ * Order the commands and lay their *
+ * quads out in that order.         *
+ *==================================*/
+static void sortQueue(renderqueue *q) {
+  int at = 0;
+
+  qsort(q->commands, q->num_commands, sizeof(drawcommand), compareCommands);
+  for (int i=0; i<q->num_commands; i++) {
+    drawcommand *c = &q->commands[i];
+    memcpy(&q->sorted[at*4], &q->verts[c->first*4],
+           c->count*4*sizeof(SDL_Vertex));
+    c->first = at;
+    at += c->count;
+  }
+
+  // The sorted copy becomes the queue; the old order is scratch now
+  {
+    SDL_Vertex *tmp = q->verts;
+    q->verts = q->sorted;
+    q->sorted = tmp;
+  }
+  q->is_sorted = 1;
+}
+
+
+/*================< drawRuns >=================*
+ * One call per run of layer and texture, up   *
+ * to last_layer. With a map, textures are     *
+ * swapped for their copies and runs with no   *
+ * copy are skipped.                           *
+ *=============================================*/
+static void drawRuns(renderqueue *q, SDL_Renderer *renderer,
+                     const texturepair *map, int num_pairs, int last_layer) {
+  if (q->num_commands == 0) return;
+  if (!q->is_sorted) sortQueue(q);
+
+  // Flat quads take the draw blend mode; textured ones their own
+  SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+  for (int i=0; i<q->num_commands; ) {
+    const drawcommand *c = &q->commands[i];
+    SDL_Texture *texture = c->texture;
+    int first = c->first, count = 0;
+
+    if (c->layer > last_layer) break;
+    for (; i<q->num_commands && q->commands[i].layer == c->layer &&
+           q->commands[i].texture == c->texture; i++)
+      count += q->commands[i].count;
+
+    if (map && texture) {
+      int p = 0;
+      while (p < num_pairs && map[p].from != texture) p++;
+      if (p == num_pairs) continue;
+      texture = map[p].to;
+    }
+    SDL_RenderGeometry(renderer, texture, q->verts + first*4, count*4,
+                       q->indices, count*6);
+    perf.draw_calls++;
+  }
+  SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+}
+
+
+/*===============< queueDraw >================*
+ * Draw everything queued, one call per run   *
+ * of layer and texture, and keep it queued   *
+ * (e.g. to draw again under another clip).   *
+ *============================================*/
+void queueDraw(renderqueue *q, SDL_Renderer *renderer) {
+  drawRuns(q, renderer, NULL, 0, NUM_LAYERS);
+}
+
+
+/*==================< queueMirror >===================*
+ * Draw the queue again in another renderer, layers   *
+ * up to last_layer, using the copies in map. The     *
+ * frame is laid out and sorted once however many     *
+ * windows show it.                                   *
+ *====================================================*/
+void queueMirror(renderqueue *q, SDL_Renderer *renderer,
+                 const texturepair *map, int num_pairs, int last_layer) {
+  drawRuns(q, renderer, map, num_pairs, last_layer);
+}
+
+
+void queueClear(renderqueue *q) {
+  q->num_commands = 0;
+  q->num_quads = 0;
+}
+
+
+/*===========< queueFlush >============*
+ * Draw everything and empty the queue *
+ *=====================================*/
+void queueFlush(renderqueue *q, SDL_Renderer *renderer) {
+  queueDraw(q, renderer);
+  queueClear(q);
+}
+
+
+void queueFree(renderqueue *q) {
+  free(q->commands);
+  free(q->verts);
+  free(q->sorted);
+  free(q->indices);
+  memset(q, 0, sizeof(*q));
+}
@@ -0,0 +1,59 @@
+/* Render Queue */
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <SDL2/SDL.h>
+
+#include "atlas.h"
+
+/* Back to front. Within a layer things are drawn grouped by texture, so
+ * anything that overlaps something with a different texture needs its
+ * own layer. */
+enum {
+  LAYER_TEXT,           // Title, pitch name, score; notes pass over them
+  LAYER_WORLD,          // Highway, notes, player, sparks
+  LAYER_OVERLAY,        // Panels behind overlay text
+  LAYER_OVERLAY_TEXT,   // HUD numbers
+  NUM_LAYERS
+};
+
+typedef struct {
+  int layer;
+  SDL_Texture *texture;   // NULL: flat colored quads
+  int seq;                // Submission order, to keep the sort stable
+  int first, count;       // Quads in the queue's vertex buffer
+} drawcommand;
+
+/* A texture and its copy in another renderer (SDL renderers can't share
+ * textures) */
+typedef struct {
+  SDL_Texture *from, *to;
+} texturepair;
+
+/* One frame's worth of textured and flat quads */
+typedef struct {
+  drawcommand *commands;
+  int num_commands, max_commands;
+  SDL_Vertex *verts;      // 4 per quad; regrouped by layer/texture once sorted
+  SDL_Vertex *sorted;     // Scratch for the sort
+  int *indices;           // 6 per quad, shared by every draw
+  int num_quads, max_quads;
+  int is_sorted;
+} renderqueue;
+
+void queueQuads(renderqueue *q, int layer, SDL_Texture *texture,
+                const SDL_Vertex *verts, int num_quads);
+void queueBatch(renderqueue *q, int layer, spritebatch *b,
+                SDL_Texture *texture);
+void queueTexture(renderqueue *q, int layer, SDL_Texture *texture,
+                  const SDL_Rect *dst);
+void queueFill(renderqueue *q, int layer, const SDL_Rect *r, SDL_Color color);
+void queueDraw(renderqueue *q, SDL_Renderer *renderer);
+void queueMirror(renderqueue *q, SDL_Renderer *renderer,
+                 const texturepair *map, int num_pairs, int last_layer);
+void queueClear(renderqueue *q);
+void queueFlush(renderqueue *q, SDL_Renderer *renderer);
+void queueFree(renderqueue *q);
+
+#endif
@@ -0,0 +1,423 @@
+/*=======================*
+ |     Render Thread     |
+ *=======================*/
+
+/* Owns the renderer and everything that lives in it (fonts, text cache,
+ * HUD glyphs, atlas). It draws whatever game state was published last,
+ * so a slow present never holds up input or the simulation, and a burst
+ * of input never holds up drawing.
+ *
+ * The game is laid out in WIDTH x HEIGHT logical pixels, which SDL scales
+ * and letterboxes to whatever size the window is. Fonts, glyphs and
+ * sprites are rasterized at that scale up front (and again only if the
+ * window changes size), so they're drawn 1:1 rather than stretched.
+ *
+ * macOS won't let any thread but main touch a window or renderer, so
+ * there (RENDER_ON_MAIN) nothing is spawned: the same setup runs on main,
+ * and main's loop calls pumpRenderer to draw each new snapshot.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "game.h"
+#include "renderthread.h"
+#include "hud.h"
+#include "text.h"
+#include "atlas.h"
+#include "particles.h"
+#include "dirty.h"
+#include "probe.h"
+#include "governor.h"
+#include "menu.h"
+
+
+/*============< fitWindow >=============*
+ * Map the logical WIDTH x HEIGHT onto  *
+ * the window (letterboxed) and return  *
+ * screen pixels per logical pixel.     *
+ *======================================*/
+static float fitWindow(SDL_Renderer *renderer) {
+  float sx, sy;
+  SDL_RenderSetLogicalSize(renderer, WIDTH, HEIGHT);
+  SDL_RenderGetScale(renderer, &sx, &sy);
+  return sx > 0 ? sx : 1;
+}
+
+
+/*==========< loadAssets >===========*
+ * Font, glyphs and sprites, all     *
+ * rasterized at scale. Returns the  *
+ * font, or NULL if setup failed.    *
+ *===================================*/
+static TTF_Font *loadAssets(SDL_Renderer *renderer, float scale) {
+  TTF_Font *font = TTF_OpenFont(FONT_PATH, (int)(72*scale + 0.5f));
+
+  if (font == NULL) {
+    printf("Font not found\n");
+    return NULL;
+  }
+  if (hudInit(renderer, FONT_PATH, scale))
+    printf("Error creating HUD glyphs: %s\n", SDL_GetError());
+  if (menuLoad(renderer, FONT_PATH, scale))
+    printf("Error creating song menu: %s\n", SDL_GetError());
+  if (digitsInit(&score_digits, renderer, FONT_PATH, SCORE_FONT_SIZE, NULL,
+                 scale))
+    printf("Error creating score glyphs: %s\n", SDL_GetError());
+
+  if (atlasLoad(&game_atlas, renderer, scale)) {
+    printf("Error building sprite atlas: %s\n", SDL_GetError());
+    menuUnload();
+    hudQuit();
+    digitsFree(&score_digits);
+    TTF_CloseFont(font);
+    return NULL;
+  }
+  return font;
+}
+
+static void freeAssets(TTF_Font *font) {
+  menuUnload();
+  hudQuit();
+  digitsFree(&score_digits);
+  clearTextCache();
+  atlasFree(&game_atlas);
+  TTF_CloseFont(font);
+}
+
+
+/*===============< resizeRenderer >================*
+ * The window changed size. Re-fit the logical     *
+ * area and, if the scale changed, rasterize the   *
+ * assets again. A software renderer is rebuilt on *
+ * the new window surface. If the assets won't     *
+ * load at the new scale they're loaded at the old *
+ * one, and SDL stretches them. Returns 0 on       *
+ * success; nonzero means nothing can be drawn.    *
+ *=================================================*/
+static int resizeRenderer(SDL_Window *window, SDL_Renderer **renderer,
+                          TTF_Font **font, float *scale, int software) {
+  float fit;
+
+  if (software) {
+    SDL_Surface *surface;
+    freeAssets(*font);
+    *font = NULL;
+    SDL_DestroyRenderer(*renderer);
+    surface = SDL_GetWindowSurface(window);
+    *renderer = surface ? SDL_CreateSoftwareRenderer(surface) : NULL;
+    if (*renderer == NULL) return 1;
+    fit = fitWindow(*renderer);
+  }
+  else {
+    fit = fitWindow(*renderer);
+    if (fabsf(fit - *scale) < 0.01f) return 0;
+    freeAssets(*font);
+  }
+
+  *font = loadAssets(*renderer, fit);
+  if (*font) {
+    *scale = fit;
+    return 0;
+  }
+  printf("Error resizing assets, keeping them at %.2fx\n", *scale);
+  *font = loadAssets(*renderer, *scale);
+  return *font == NULL;
+}
+
+
+/*==============< setupRenderer >===============*
+ * Create the renderer and everything drawn     *
+ * with it: fonts, sprites, capture, audience.  *
+ * Returns 0 on success.                        *
+ *==============================================*/
+static int setupRenderer(renderthread *rt) {
+  SDL_RendererInfo info;
+  int driver;
+  Uint32 flags;
+
+  // Renderer resources have to be created on the thread that uses them
+  driver = pickRenderDriver(rt->window, rt->reprobe, &flags);
+  rt->renderer = SDL_CreateRenderer(rt->window, driver, flags);
+  if (rt->renderer == NULL) {
+    printf("Error creating renderer: %s\n", SDL_GetError());
+    return 1;
+  }
+
+  // No GPU: draw into the window surface so we can redraw just what changed
+  rt->software = 0;
+  SDL_GetRendererInfo(rt->renderer, &info);
+  if (info.flags & SDL_RENDERER_SOFTWARE) {
+    SDL_Surface *surface = SDL_GetWindowSurface(rt->window);
+    SDL_Renderer *direct = surface ? SDL_CreateSoftwareRenderer(surface) : NULL;
+    if (direct) {
+      SDL_DestroyRenderer(rt->renderer);
+      rt->renderer = direct;
+      rt->software = 1;
+      initDirty(&rt->dirty);
+    }
+  }
+
+  // Everything is laid out in WIDTH x HEIGHT and scaled to the window
+  SDL_GetWindowSize(rt->window, &rt->win_w, &rt->win_h);
+  rt->scale = fitWindow(rt->renderer);
+  rt->font = loadAssets(rt->renderer, rt->scale);
+  if (rt->font == NULL) {
+    SDL_DestroyRenderer(rt->renderer);
+    rt->renderer = NULL;
+    return 1;
+  }
+
+  // Video capture of the play area. A Y4M can't change size partway, so
+  // it's recorded at the logical size whatever the window does
+  if (rt->capture_path)
+    perf.capturing = (startCapture(&rt->cap, rt->capture_path,
+                                   rt->capture_policy, WIDTH, HEIGHT) == 0);
+
+  // Audience mirror, sharing this thread and the frame queue
+  if (rt->audience_window &&
+      audienceInit(&rt->crowd, rt->audience_window, driver, rt->scale)) {
+    printf("Error creating audience renderer: %s\n", SDL_GetError());
+    SDL_HideWindow(rt->audience_window);
+  }
+
+  rt->seen_effect = 0;
+  rt->last_frame = 0;
+  rt->last_present = SDL_GetPerformanceCounter();
+  return 0;
+}
+
+
+/*===============< drawLatest >================*
+ * Draw and present the newest snapshot.       *
+ * Returns 0 on success; nonzero means nothing *
+ * can be drawn any more.                      *
+ *=============================================*/
+static int drawLatest(renderthread *rt) {
+  const gamestate *state = latestSnapshot(rt->snapshots);
+  Uint64 draw_start = SDL_GetPerformanceCounter(), now;
+  double draw_ms;
+  int w, h;
+
+  // Window resized or went fullscreen
+  SDL_GetWindowSize(rt->window, &w, &h);
+  if (w != rt->win_w || h != rt->win_h) {
+    rt->win_w = w;
+    rt->win_h = h;
+    if (resizeRenderer(rt->window, &rt->renderer, &rt->font, &rt->scale,
+                       rt->software)) {
+      printf("Error resizing renderer: %s\n", SDL_GetError());
+      return 1;
+    }
+    if (rt->software) initDirty(&rt->dirty);
+    if (rt->crowd.renderer && audienceRescale(&rt->crowd, rt->scale))
+      printf("Error rebuilding audience sprites: %s\n", SDL_GetError());
+  }
+
+  // A sprite in assets/ was edited: rebuild the atlas from the files,
+  // keeping the old one if the new one won't build
+  if (rt->reload && assetsChanged(rt->reload)) {
+    atlas fresh;
+    if (atlasLoad(&fresh, rt->renderer, rt->scale)) {
+      printf("Error rebuilding sprite atlas: %s\n", SDL_GetError());
+      atlasFree(&fresh);
+    }
+    else {
+      atlasFree(&game_atlas);
+      game_atlas = fresh;
+      if (rt->software) initDirty(&rt->dirty);
+      if (rt->crowd.renderer && audienceRescale(&rt->crowd, rt->scale))
+        printf("Error rebuilding audience sprites: %s\n", SDL_GetError());
+    }
+  }
+
+  // Sparks are purely visual, so they're simulated here
+  playEffects(state, &rt->seen_effect);
+  updateParticles(&particles, (float)(state->frame - rt->last_frame));
+  rt->last_frame = state->frame;
+
+  if (rt->software) {
+    renderDirty(&rt->dirty, rt->window, rt->renderer, rt->font, state);
+    if (perf.capturing)
+      captureFrame(&rt->cap, rt->renderer, state->frame);
+    draw_ms = (SDL_GetPerformanceCounter() - draw_start)*1000.0/
+              SDL_GetPerformanceFrequency();
+  }
+  else {
+    renderFrame(rt->renderer, rt->font, state, NULL);
+    if (perf.capturing)
+      captureFrame(&rt->cap, rt->renderer, state->frame);
+    // Before present, which waits for vsync
+    draw_ms = (SDL_GetPerformanceCounter() - draw_start)*1000.0/
+              SDL_GetPerformanceFrequency();
+    SDL_RenderPresent(rt->renderer);
+  }
+  audienceDraw(&rt->crowd, state);
+
+  now = SDL_GetPerformanceCounter();
+  hudEndFrame((now - rt->last_present)*1000.0/SDL_GetPerformanceFrequency());
+  governFrame(&quality, (now - rt->last_present)*1000.0/
+              SDL_GetPerformanceFrequency(), draw_ms);
+  rt->last_present = now;
+  return 0;
+}
+
+
+/*=============< stopDrawing >==============*
+ * Stop reading snapshots. After an error,  *
+ * have main quit rather than sit on a      *
+ * frozen frame.                            *
+ *==========================================*/
+static void stopDrawing(renderthread *rt) {
+  SDL_AtomicSet(&rt->running, 0);
+  if (!SDL_AtomicGet(&rt->quit)) {
+    SDL_Event event = {.type = SDL_QUIT};
+    SDL_PushEvent(&event);
+  }
+}
+
+
+/* Cleanup, on the same thread as setupRenderer */
+static void freeRenderer(renderthread *rt) {
+  if (perf.capturing) stopCapture(&rt->cap);
+  perf.capturing = 0;
+  audienceFree(&rt->crowd);
+  if (rt->font) freeAssets(rt->font);
+  batchFree(&sprites);
+  queueFree(&frame_queue);
+  if (rt->renderer) SDL_DestroyRenderer(rt->renderer);
+  rt->font = NULL;
+  rt->renderer = NULL;
+}
+
+
+#ifndef RENDER_ON_MAIN
+
+/*=============< renderLoop >==============*
+ * Set up the renderer and its resources,  *
+ * then draw snapshots until told to quit. *
+ *=========================================*/
+static int renderLoop(void *data) {
+  renderthread *rt = data;
+
+  rt->status = setupRenderer(rt);
+  if (rt->status == 0) SDL_AtomicSet(&rt->running, 1);
+  SDL_SemPost(rt->ready);
+  if (rt->status) return 1;
+
+  while (!SDL_AtomicGet(&rt->quit)) {
+    // Nothing new to show: don't burn a core redrawing the same frame
+    if (!snapshotFresh(rt->snapshots)) {
+      SDL_Delay(1);
+      continue;
+    }
+    if (drawLatest(rt)) break;
+  }
+
+  stopDrawing(rt);
+  freeRenderer(rt);
+  return 0;
+}
+
+
+/*============< startRenderThread >=============*
+ * Spawn the render thread for window and wait  *
+ * until it's set up. Returns 0 on success.     *
+ *==============================================*/
+int startRenderThread(renderthread *rt, SDL_Window *window,
+                      snapshotbuffer *snapshots) {
+  rt->window = window;
+  rt->snapshots = snapshots;   // capture_path/policy are set by the caller
+  rt->status = 1;
+  SDL_AtomicSet(&rt->quit, 0);
+  SDL_AtomicSet(&rt->running, 0);
+
+  rt->ready = SDL_CreateSemaphore(0);
+  if (rt->ready == NULL) return 1;
+
+  rt->thread = SDL_CreateThread(renderLoop, "render", rt);
+  if (rt->thread == NULL) {
+    SDL_DestroySemaphore(rt->ready);
+    return 1;
+  }
+
+  SDL_SemWait(rt->ready);
+  if (rt->status) {
+    SDL_WaitThread(rt->thread, NULL);
+    rt->thread = NULL;
+  }
+  return rt->status;
+}
+
+
+/*============< waitForRenderer >=============*
+ * Wait until the render thread has picked up *
+ * the newest snapshot, and so is done with   *
+ * every one before it. Returns at once if    *
+ * the thread has stopped.                    *
+ *============================================*/
+void waitForRenderer(renderthread *rt) {
+  while (SDL_AtomicGet(&rt->running) && !snapshotTaken(rt->snapshots))
+    SDL_Delay(1);
+}
+
+
+/*===========< stopRenderThread >============*
+ * Ask the render thread to finish and wait. *
+ *===========================================*/
+void stopRenderThread(renderthread *rt) {
+  SDL_AtomicSet(&rt->quit, 1);
+  if (rt->thread) SDL_WaitThread(rt->thread, NULL);
+  rt->thread = NULL;
+  SDL_DestroySemaphore(rt->ready);
+}
+
+#else
+
+/*============< startRenderThread >=============*
+ * Set up rendering on the calling (main)       *
+ * thread. Returns 0 on success.                *
+ *==============================================*/
+int startRenderThread(renderthread *rt, SDL_Window *window,
+                      snapshotbuffer *snapshots) {
+  rt->window = window;
+  rt->snapshots = snapshots;
+  rt->thread = NULL;
+  rt->ready = NULL;
+  SDL_AtomicSet(&rt->quit, 0);
+  rt->status = setupRenderer(rt);
+  SDL_AtomicSet(&rt->running, rt->status == 0);
+  return rt->status;
+}
+
+
+/*==============< pumpRenderer >===============*
+ * Draw the newest snapshot, if there's one we *
+ * haven't drawn. Called from main's loop.     *
+ *=============================================*/
+void pumpRenderer(renderthread *rt) {
+  if (!SDL_AtomicGet(&rt->running) || !snapshotFresh(rt->snapshots))
+    return;
+  if (drawLatest(rt)) stopDrawing(rt);
+}
+
+
+/*============< waitForRenderer >=============*
+ * Nothing to wait for: main draws between    *
+ * steps, so no old snapshot is being read.   *
+ *============================================*/
+void waitForRenderer(renderthread *rt) {
+  (void)rt;
+}
+
+
+/*===========< stopRenderThread >============*
+ * Free everything setup made, here on main. *
+ *===========================================*/
+void stopRenderThread(renderthread *rt) {
+  SDL_AtomicSet(&rt->quit, 1);
+  SDL_AtomicSet(&rt->running, 0);
+  freeRenderer(rt);
+}
+
+#endif
@@ -0,0 +1,59 @@
+/* Render Thread */
+
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <SDL2/SDL.h>
+
+#include "state.h"
+#include "capture.h"
+#include "audience.h"
+#include "reload.h"
+#include "dirty.h"
+
+/* macOS only lets the main thread use windows and renderers. There the
+ * same code runs on main instead, drawn from its loop by pumpRenderer. */
+#ifdef __APPLE__
+#define RENDER_ON_MAIN
+#endif
+
+typedef struct {
+  SDL_Window *window;
+  snapshotbuffer *snapshots;    // Where game states come from
+  SDL_Thread *thread;
+  SDL_sem *ready;               // Posted once setup is done (or failed)
+  SDL_atomic_t quit;
+  SDL_atomic_t running;         // Set while the thread reads snapshots
+  int status;                   // Nonzero if setup failed
+  int reprobe;                  // Benchmark render drivers again
+
+  const char *capture_path;     // Record to this .y4m, or NULL
+  int capture_policy;
+  capture cap;
+
+  SDL_Window *audience_window;  // Mirror for the crowd, or NULL
+  audience crowd;
+
+  hotreload *reload;            // Says when sprites change, or NULL
+
+  // Owned by whichever thread renders
+  SDL_Renderer *renderer;
+  TTF_Font *font;
+  int software;                 // Drawing straight into the window surface?
+  dirtytracker dirty;
+  float scale;                  // Screen pixels per logical pixel
+  int win_w, win_h;
+  Uint32 seen_effect;           // Newest effect already turned into sparks
+  uint64_t last_frame;
+  Uint64 last_present;
+} renderthread;
+
+int startRenderThread(renderthread *rt, SDL_Window *window,
+                      snapshotbuffer *snapshots);
+#ifdef RENDER_ON_MAIN
+void pumpRenderer(renderthread *rt);
+#endif
+void waitForRenderer(renderthread *rt);
+void stopRenderThread(renderthread *rt);
+
+#endif
@@ -0,0 +1,87 @@
+/*=======================*
+ |  Game State Snapshots |
+ *=======================*/
+
+/* Hand-off between the logic thread and the render thread. See state.h
+ * for the triple buffer; this is the writer and reader side of it.
+ */
+
+#include <string.h>
+
+#include "state.h"
+
+
+/*=========< initSnapshots >=========*
+ * All slots empty, nothing fresh.   *
+ *===================================*/
+void initSnapshots(snapshotbuffer *sb) {
+  memset(sb, 0, sizeof(*sb));
+  sb->back = 0;
+  sb->front = 1;
+  SDL_AtomicSet(&sb->middle, 2);
+}
+
+
+/*===========< snapshotBack >============*
+ * Slot the writer fills for next publish *
+ *========================================*/
+gamestate *snapshotBack(snapshotbuffer *sb) {
+  return &sb->slots[sb->back];
+}
+
+
+/*============< publishSnapshot >=============*
+ * Hand the back slot to the reader and take  *
+ * whichever slot was in the middle.          *
+ *============================================*/
+void publishSnapshot(snapshotbuffer *sb) {
+  SDL_MemoryBarrierRelease();   // Slot contents before the index
+  sb->back = SDL_AtomicSet(&sb->middle, sb->back | SNAPSHOT_FRESH) & 3;
+}
+
+
+/*=============< snapshotFresh >==============*
+ * Has the writer published since the reader *
+ * last looked?                               *
+ *============================================*/
+int snapshotFresh(snapshotbuffer *sb) {
+  return SDL_AtomicGet(&sb->middle) & SNAPSHOT_FRESH;
+}
+
+
+/*=============< snapshotTaken >==============*
+ * Has the reader picked up the newest       *
+ * snapshot? If so it's done with every one  *
+ * before it.                                *
+ *============================================*/
+int snapshotTaken(snapshotbuffer *sb) {
+  return !snapshotFresh(sb);
+}
+
+
+/*============< latestSnapshot >=============*
+ * Newest complete snapshot. Stays valid     *
+ * until the next call from the reader.      *
+ *===========================================*/
+const gamestate *latestSnapshot(snapshotbuffer *sb) {
+  if (snapshotFresh(sb)) {
+    sb->front = SDL_AtomicSet(&sb->middle, sb->front) & 3;
+    SDL_MemoryBarrierAcquire();
+  }
+  return &sb->slots[sb->front];
+}
+
+
+/*==============< addEffect >===============*
+ * Record a hit/miss for the renderer. Old  *
+ * ones fall off the end of the ring.       *
+ *==========================================*/
+void addEffect(gamestate *state, int lane, int hit) {
+  effect *e;
+
+  state->effect_seq++;
+  e = &state->effects[state->effect_seq%EFFECT_HISTORY];
+  e->seq = state->effect_seq;
+  e->lane = lane;
+  e->hit = hit;
+}
@@ -0,0 +1,68 @@
+/* Game State Snapshots */
+
+#ifndef STATE_H
+#define STATE_H
+
+#include <SDL2/SDL.h>
+
+#include "theremin.h"
+#include "menu.h"
+
+#define EFFECT_HISTORY 64       // Effects a snapshot remembers
+#define SNAPSHOT_FRESH 4        // Flag bit on the shared slot index
+
+/* Something the renderer should show once (hit/miss sparks) */
+typedef struct {
+  Uint32 seq;                   // 1, 2, 3... in order of happening
+  Uint8 lane;
+  Uint8 hit;
+} effect;
+
+/* One part of the chart as it's drawn. The cursor only moves forward as
+ * the song plays, so finding what's on screen is never a search. */
+typedef struct {
+  notearena notes;              // Shared, read-only while playing
+  int first_shown;              // First note not scrolled off the bottom
+} partcursor;
+
+/* Everything the renderer needs to draw one frame. The logic thread fills
+ * one in, publishes it, and never touches it again. */
+typedef struct {
+  uint64_t frame;               // Game time in 60 Hz frames
+  int64_t song_time;            // Song position in TIMELINE_RATE samples
+  int pitchindex;               // Pitch the player is on
+  int colorblind;
+  int perspective;              // Tilted highway instead of flat
+  int hud;                      // Performance HUD shown?
+  partcursor parts[MAX_PARTS];  // Chart, part by part
+  int num_parts;
+  int played_part;              // The part that's judged, drawn on top
+  unsigned shown_parts;         // Bit i set: part i is drawn (and heard)
+  int next_note;                // First note of the played part not judged
+  menuview menu;                // Song select, drawn instead while active
+  unsigned long score;
+  int combo;                    // Hits in a row
+  Uint32 effect_seq;            // seq of the newest effect (0 = none yet)
+  effect effects[EFFECT_HISTORY];   // Ring, indexed by seq%EFFECT_HISTORY
+} gamestate;
+
+/* Lock-free triple buffer: the writer always has a slot to fill, the
+ * reader always has a complete slot to draw, and they trade through the
+ * middle one with a single atomic exchange. Neither side ever waits. */
+typedef struct {
+  gamestate slots[3];
+  int back;                     // Writer's slot
+  int front;                    // Reader's slot
+  SDL_atomic_t middle;          // Slot index | SNAPSHOT_FRESH
+} snapshotbuffer;
+
+void initSnapshots(snapshotbuffer *sb);
+gamestate *snapshotBack(snapshotbuffer *sb);
+void publishSnapshot(snapshotbuffer *sb);
+int snapshotFresh(snapshotbuffer *sb);
+int snapshotTaken(snapshotbuffer *sb);
+const gamestate *latestSnapshot(snapshotbuffer *sb);
+
+void addEffect(gamestate *state, int lane, int hit);
+
+#endif
@@ -0,0 +1,92 @@
+/*=======================*
+ *  Text Texture Cache   *
+ *=======================*/
+
+/* TTF_RenderText_* plus SDL_CreateTextureFromSurface is by far the most
+ * expensive thing we can do in a frame, and the strings on screen hardly
+ * ever change. Rendered strings are kept here, keyed by font, color and
+ * contents, and the least recently used one is thrown out when full.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "text.h"
+#include "hud.h"
+
+typedef struct {
+  TTF_Font *font;
+  SDL_Color color;
+  char *str;                  // Whole string, owned by the entry
+  SDL_Texture *texture;
+  Uint64 last_used;           // Frame stamp for LRU eviction
+} textentry;
+
+static textentry cache[TEXT_CACHE_SIZE];
+static Uint64 use_cntr = 0;
+
+
+/*===============< getTextTexture >================*
+ * Return a texture with str rendered in color.    *
+ * The texture belongs to the cache; don't free it.*
+ *=================================================*/
+SDL_Texture *getTextTexture(SDL_Renderer *renderer, TTF_Font *font,
+                            const char *str, SDL_Color color) {
+  textentry *victim = &cache[0];
+  SDL_Surface *surface;
+
+  use_cntr++;
+  for (int i=0; i<TEXT_CACHE_SIZE; i++) {
+    textentry *e = &cache[i];
+    if (e->texture && e->font == font &&
+        e->color.r == color.r && e->color.g == color.g &&
+        e->color.b == color.b && strcmp(e->str, str) == 0) {
+      e->last_used = use_cntr;
+      perf.text_hits++;
+      return e->texture;
+    }
+    if (e->last_used < victim->last_used) victim = e;
+  }
+
+  // Miss: rasterize and take over the least recently used slot
+  perf.text_misses++;
+  surface = TTF_RenderText_Solid(font, str, color);
+  if (surface == NULL) return NULL;
+
+  if (victim->texture) {
+    SDL_DestroyTexture(victim->texture);
+    perf.textures--;
+  }
+  free(victim->str);
+  victim->str = strdup(str);
+  victim->texture = victim->str ?
+                    SDL_CreateTextureFromSurface(renderer, surface) : NULL;
+  SDL_FreeSurface(surface);
+  if (victim->texture == NULL) {
+    victim->last_used = 0;
+    return NULL;
+  }
+  perf.textures++;
+  perf.textures_created++;
+
+  victim->font = font;
+  victim->color = color;
+  victim->last_used = use_cntr;
+  return victim->texture;
+}
+
+
+/*===========< clearTextCache >============*
+ * Free every cached texture. Call before  *
+ * destroying the renderer they live in.   *
+ *=========================================*/
+void clearTextCache(void) {
+  for (int i=0; i<TEXT_CACHE_SIZE; i++) {
+    if (cache[i].texture) {
+      SDL_DestroyTexture(cache[i].texture);
+      perf.textures--;
+    }
+    free(cache[i].str);
+    memset(&cache[i], 0, sizeof(cache[i]));
+  }
+}
@@ -0,0 +1,15 @@
+/* Text Texture Cache */
+
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#define TEXT_CACHE_SIZE 16    // Number of rendered strings kept around
+
+SDL_Texture *getTextTexture(SDL_Renderer *renderer, TTF_Font *font,
+                            const char *str, SDL_Color color);
+void clearTextCache(void);
+
+#endif
@@ -2,6 +2,70 @@
  * Theremin Hero Library *
  *=======================*/
 
+#include <stdlib.h>
+#include <string.h>
+
+#include "theremin.h"
+
+/* Frequency of each lane, in Hz */
+float pitches[] = {
+  261.63, // C4
+  293.66, // D4
+  329.63, // E4
+  349.23, // F4
+  392.00, // G4
+  440.00, // A4
+  493.88, // B4
+  523.25  // C5
+};
+
 int readFromTheremin() {
   return 0;
 }
+
+
+/*=============< allocNotes >==============*
+ * Room for max_notes notes, every column  *
+ * carved out of one block. count starts   *
+ * at 0. Returns 0 on success.             *
+ *=========================================*/
+int allocNotes(notearena *n, int max_notes) {
+  memset(n, 0, sizeof(*n));
+  if (max_notes < 1) max_notes = 1;
+  n->block = calloc(max_notes, 2*sizeof(int64_t) + 2*sizeof(uint8_t));
+  if (n->block == NULL) return 1;
+
+  // Widest columns first so each one stays aligned
+  n->start = n->block;
+  n->end = n->start + max_notes;
+  n->pitch = (uint8_t*)(n->end + max_notes);
+  n->flags = n->pitch + max_notes;
+  return 0;
+}
+
+
+/*==========< freeNotes >===========*
+ * The whole song, in one free.     *
+ *==================================*/
+void freeNotes(notearena *n) {
+  free(n->block);
+  memset(n, 0, sizeof(*n));
+}
+
+
+/*=============< findNote >==============*
+ * Index of the first note still going   *
+ * at sample t (count if none). Binary   *
+ * search, so drawing and judging never  *
+ * walk from the start of the song.      *
+ *=======================================*/
+int findNote(const notearena *n, int64_t t) {
+  int lo = 0, hi = n->count;
+
+  while (lo < hi) {
+    int mid = lo + (hi - lo)/2;
+    if (n->end[mid] <= t) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
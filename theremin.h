@@ -1,8 +1,33 @@
 /* Theremin Interface Code */
 
+#ifndef THEREMIN_H
+#define THEREMIN_H
+
+#include <stdint.h>
+
+#define TIMELINE_RATE 48000   // Song time is counted in samples at this rate
+#define NOTE_SUSTAIN 1        // Long enough to draw a trail behind its head
+#define MAX_PARTS 8           // Parts (lead, harmony, bass...) in one chart
+
+/* A song's notes, one column per field, in one block: note i is start[i],
+ * end[i], pitch[i] and flags[i]. Code that walks the chart reads only the
+ * columns it needs. Times are absolute, in TIMELINE_RATE samples from the
+ * start of the song; notes are in order and don't overlap, so both start
+ * and end only ever go up. */
 typedef struct {
-  int pitch;
-  double duration;
-} *note;
+  int64_t *start;             // Sample the note reaches the hit line
+  int64_t *end;               // Sample it's over
+  uint8_t *pitch;             // Lane index
+  uint8_t *flags;             // NOTE_* bits
+  int count;
+  void *block;                // All four columns
+} notearena;
+
+extern float pitches[];
 
 int readFromTheremin();
+int allocNotes(notearena *n, int max_notes);
+void freeNotes(notearena *n);
+int findNote(const notearena *n, int64_t t);
+
+#endif
@@ -14,6 +14,21 @@
 #include <math.h>
 
 #include "theremin.h"
+#include "game.h"
+#include "hud.h"
+#include "text.h"
+#include "bench.h"
+#include "atlas.h"
+#include "particles.h"
+#include "state.h"
+#include "renderthread.h"
+#include "highway.h"
+#include "digits.h"
+#include "governor.h"
+#include "chart.h"
+#include "library.h"
+#include "menu.h"
+#include "reload.h"
 
 #ifndef M_PI
   #define M_PI 3.1415926535897932384
@@ -24,8 +39,7 @@
 #define PIANO 2
 #define GUITAR 0.5
 
-#define WIDTH 512
-#define HEIGHT 768
+#define BACKING_LEVEL 0.3     // Each backing part's volume, next to yours
 
 /*==========<< GLOBALS >>===========*/
 
@@ -34,16 +48,6 @@ uint64_t frame_cntr = 0; /* Frame counter for updating drawing */
 int quit = 0;         /* Did the user hit quit? */
 float instr = PIANO;  /* Chosen instrument */
 
-float pitches[] = {
-  261.63, // C4
-  293.66, // D4
-  329.63, // E4
-  349.23, // F4
-  392.00, // G4
-  440.00, // A4
-  493.88, // B4
-  523.25  // C5
-};
 char* pitchNames[] = {
   "C4",
   "D4",
@@ -55,9 +59,43 @@ char* pitchNames[] = {
   "C5"
 };
 
+// Where the text goes: {xPos, yPos, width, height}
+const SDL_Rect titleRect = {150, 200, 200, 80};
+const SDL_Rect pitchRect = {210, 350, 100, 50};
+const SDL_Rect scoreRect = {WIDTH-170, 8, 162, 3*SCORE_LINE};
+
+const char* stageNames[] = {
+  "clear",
+  "text",
+  "lanes",
+  "notes",
+  "player",
+  "particles",
+  "hud"
+};
+
+// Gameplay sprites, and the batch they're drawn through
+atlas game_atlas;
+spritebatch sprites;
+
+// Everything drawn after the clear, sorted into as few calls as possible
+renderqueue frame_queue;
+
+// Glyphs for score, combo and song time
+digitatlas score_digits;
+
 // Settings
 int colorblind = 0;
 int mute = 0;
+int perspective = 0;
+
+/* A part the synth plays along with you. Its cursor belongs to the audio
+ * callback and only moves forward. */
+typedef struct {
+  notearena notes;            // Shared, read-only while playing
+  int next;                   // First note that hasn't ended
+  double phase;
+} backingvoice;
 
 /* AUDIO wavedata/userdata struct */
 typedef struct {
@@ -67,11 +105,18 @@ typedef struct {
   //int carrier_pitch;          // Frequency of carrier that determines pitch
   int pitchindex;
   int modulator_pitch;        // Frequency of modulator
+  Uint64 samples_played;      // Audio clock: samples handed to the device
+  Uint64 played_at;           // Performance counter when that last moved
+  int64_t song_zero;          // Audio clock when the song started
+  backingvoice voices[MAX_PARTS];
+  int num_voices;
 } wavedata;
 
 /* Functions */
 void createWant(SDL_AudioSpec *wantpoint, wavedata *userdata);
 void updateWavedata(wavedata *userdata, int newPitch);
+int64_t songTime(SDL_AudioDeviceID dev, const SDL_AudioSpec *have,
+                 wavedata *userdata, Uint64 started);
 
 /*=========<< END GLOBALS >>=========*/
 
@@ -90,6 +135,7 @@ void updateWavedata(wavedata *userdata, int newPitch);
  * of the carrier.                                        *
  *========================================================*/
 void generateWaveform(void *userdata, Uint8 *stream, int len) {
+  Uint64 start = SDL_GetPerformanceCounter();  // For the HUD's audio load
   short *dest = (short*)stream;       // Destination of values generated
   int size = len/sizeof(short);       // Buffer size
 
@@ -101,12 +147,49 @@ void generateWaveform(void *userdata, Uint8 *stream, int len) {
   double m_phase = wave_data->modulator_phase;
   double m_amplitude = wave_data->modulator_amplitude;
 
+  /* The modulator is only evaluated every `step` samples and linearly
+   * interpolated in between; the governor raises step when the callback
+   * is close to missing its deadline. step 1 is the exact synth. */
+  int step = currentQuality(&quality)->fm_step;
+  double mod_from = 0, mod_to = sin(m_phase);
+
+  // Song position of the first sample; the device runs at TIMELINE_RATE
+  int64_t t = (int64_t)wave_data->samples_played - wave_data->song_zero;
+  double mix = 1/(1 + BACKING_LEVEL*wave_data->num_voices);
+
+  // The device keeps running while muted so the song clock does too
+  wave_data->samples_played += size;
+  wave_data->played_at = start;
+  if (mute) {
+    memset(stream, 0, len);
+    hudAudioLoad(SDL_GetPerformanceCounter() - start, size, 48000);
+    return;
+  }
+
   // Fill buffer
   for (int i=0; i<size; i++) {
-    dest[i] =
-      sin( m_amplitude * sin( m_pitch*TAU*i/48000 + m_phase )
-           + c_pitch*TAU*i/48000 + c_phase)*32767;  // <- Modulation
-    //converts from float audio to signed short
+    if (i%step == 0) {
+      mod_from = mod_to;
+      mod_to = sin(m_pitch*TAU*(i+step)/48000 + m_phase);
+    }
+    double mod = mod_from + (mod_to - mod_from)*(i%step)/step;
+    double out =
+      sin( m_amplitude * mod
+           + c_pitch*TAU*i/48000 + c_phase);  // <- Modulation
+
+    // Backing parts: a plain sine on whatever note each is on
+    for (int v=0; v<wave_data->num_voices; v++) {
+      backingvoice *voice = &wave_data->voices[v];
+      const notearena *notes = &voice->notes;
+      while (voice->next < notes->count && notes->end[voice->next] <= t + i)
+        voice->next++;
+      if (voice->next == notes->count || notes->start[voice->next] > t + i)
+        continue;
+      out += BACKING_LEVEL*sin(voice->phase);
+      voice->phase = fmod(voice->phase +
+                          pitches[notes->pitch[voice->next]]*TAU/48000, TAU);
+    }
+    dest[i] = out*mix*32767;  //converts from float audio to signed short
   }
 
   // Update phase s.t. next frame of audio starts at same point in wave
@@ -122,6 +205,8 @@ void generateWaveform(void *userdata, Uint8 *stream, int len) {
    */
   //if(m_amplitude > 0) wave_data->modulator_amplitude -= 0.0066666666;
   //else wave_data->modulator_amplitude = 0.4; //reset if we hit 0
+
+  hudAudioLoad(SDL_GetPerformanceCounter() - start, size, 48000);
 }
 
 
@@ -145,6 +230,10 @@ void createWant(SDL_AudioSpec *wantpoint, wavedata *userdata) {
   userdata->modulator_phase = 0.0;
   userdata->carrier_phase = 0.0;
   userdata->modulator_amplitude = 0.4;
+  userdata->samples_played = 0;
+  userdata->played_at = 0;
+  userdata->song_zero = 0;
+  userdata->num_voices = 0;
 
   wantpoint->userdata = userdata;
 }
@@ -161,6 +250,49 @@ void updateWavedata(wavedata *userdata, int newPitch) {
 }
 
 
+/*==================< songTime >===================*
+ * Where the song is, in TIMELINE_RATE samples. The  *
+ * audio device's count of samples played, plus the  *
+ * time since its last buffer (at most one buffer's  *
+ * worth) so it moves smoothly between callbacks.    *
+ * Without an audio device, the performance counter  *
+ * since started.                                    *
+ *===================================================*/
+int64_t songTime(SDL_AudioDeviceID dev, const SDL_AudioSpec *have,
+                 wavedata *userdata, Uint64 started) {
+  Uint64 now = SDL_GetPerformanceCounter();
+  Uint64 freq = SDL_GetPerformanceFrequency();
+  Uint64 played, at;
+  double since;
+
+  if (dev == 0)
+    return (int64_t)((double)(now - started)*TIMELINE_RATE/freq);
+
+  SDL_LockAudioDevice(dev);
+  played = userdata->samples_played;
+  at = userdata->played_at;
+  SDL_UnlockAudioDevice(dev);
+  if (played == 0) return 0;
+
+  since = (double)(now - at)*have->freq/freq;
+  if (since > have->samples) since = have->samples;
+  return (int64_t)((played + since)*TIMELINE_RATE/have->freq);
+}
+
+
+/*==============< prefFilePath >===============*
+ * Full path of file name in SDL's per-user    *
+ * pref directory, or 0 if there isn't one.    *
+ *=============================================*/
+int prefFilePath(char *out, size_t len, const char *name) {
+  char *pref = SDL_GetPrefPath("fseidel", "ThereminHero");
+  if (pref == NULL) return 0;
+  snprintf(out, len, "%s%s", pref, name);
+  SDL_free(pref);
+  return 1;
+}
+
+
 /*================< checkKey >=================*
  * Check the key that was pressed, and         *
  * respond appropriately.                      *
@@ -195,6 +327,14 @@ void checkKey(SDL_Keycode key, wavedata* wavedata_ptr) {
   else if (key == SDLK_m) {
     mute = (mute+1)%2;
   }
+  /* Flat or perspective highway */
+  else if (key == SDLK_p) {
+    perspective = (perspective+1)%2;
+  }
+  /* Performance HUD */
+  else if (key == SDLK_h) {
+    hud_visible = (hud_visible+1)%2;
+  }
 }
 
 
@@ -202,14 +342,10 @@ void checkKey(SDL_Keycode key, wavedata* wavedata_ptr) {
  * Draw rectangle that corresponds to the note  *
  * that the theremin is currently playing.      *
  *==============================================*/
-void drawNoteRectangle(int index, SDL_Renderer *renderer) {
-    SDL_Rect r;
-    r.x = index*50+50;
-    r.y = (int)(5.0/6.0*HEIGHT);
-    r.w = 50;
-    r.h = 25;
-    SDL_SetRenderDrawColor(renderer, 0,0,255,255);
-    SDL_RenderFillRect(renderer, &r);
+void drawNoteRectangle(int index) {
+  SDL_Color blue = {0, 0, 255, 255};
+  batchSprite(&sprites, &game_atlas, SPRITE_PLAYER,
+              LANE_X(index), HITLINE, LANE_WIDTH, NOTE_HEIGHT, blue);
 }
 
 
@@ -217,35 +353,509 @@ void drawNoteRectangle(int index, SDL_Renderer *renderer) {
  * Draw separating lines between note lanes      *
  * (where the notes scroll down).                *
  *===============================================*/
-void drawLaneLines(SDL_Renderer *renderer) {
-  SDL_SetRenderDrawColor(renderer, 5, 42, 100, 255);  // Dark blue
-  SDL_RenderDrawLine(renderer, 50, 50, 50, (int)(5.0/6.0*HEIGHT)+24);
-  SDL_RenderDrawLine(renderer,100, 50,100, (int)(5.0/6.0*HEIGHT)+24);
-  SDL_RenderDrawLine(renderer,150, 50,150, (int)(5.0/6.0*HEIGHT)+24);
-  SDL_RenderDrawLine(renderer,200, 50,200, (int)(5.0/6.0*HEIGHT)+24);
-  SDL_RenderDrawLine(renderer,250, 50,250, (int)(5.0/6.0*HEIGHT)+24);
-  SDL_RenderDrawLine(renderer,300, 50,300, (int)(5.0/6.0*HEIGHT)+24);
-  SDL_RenderDrawLine(renderer,350, 50,350, (int)(5.0/6.0*HEIGHT)+24);
-  SDL_RenderDrawLine(renderer,400, 50,400, (int)(5.0/6.0*HEIGHT)+24);
-  SDL_RenderDrawLine(renderer,450, 50,450, (int)(5.0/6.0*HEIGHT)+24);
+void drawLaneLines(void) {
+  SDL_Color darkBlue = {5, 42, 100, 255};
+  for (int i=0; i<=NUM_PITCHES; i++)
+    batchSprite(&sprites, &game_atlas, SPRITE_LANE,
+                LANE_X(i)-2, 50, 4, HITLINE+24-50, darkBlue);
 }
 
 
 /*==================< drawNotes >====================*
  * Draw the notes that are dropping down from above, *
- * given the array of notes.                         *
+ * given the song's note columns.                    *
+ *                                                   *
+ * Note i reaches the hit line at sample start[i].   *
+ *                                                   *
+ * Notes long enough get a sustain trail up to where *
+ * they end. While the player holds the note's pitch *
+ * its head sits on the hit line and the trail is    *
+ * eaten from the bottom. Trails go in the same      *
+ * batch, just before their head, so sustains cost   *
+ * a quad each and no extra draw calls.              *
  *                                                   *
  * Args:                                             *
- *   songNotes: array of notes                       *
+ *   notes: one part's notes                         *
  *   start: index of first note to be drawn          *
  *   end: index of last note to be drawn             *
- *   renderer: SDL_Renderer                          *
+ *   now: song time to draw them at, in samples      *
+ *   held: pitch the player is on                    *
+ *   backing: not the player's part: drawn faint,    *
+ *            and never held                         *
+ *===================================================*/
+void drawNotes(const notearena *notes, int start, int end, int64_t now,
+               int held, int backing) {
+  SDL_Color orange = {255, 140, 0, 255};
+  SDL_Color trail = {255, 140, 0, 160};
+  SDL_Color lit = {255, 200, 40, 255};
+  SDL_Color dull = {120, 120, 120, 160};
+  int y, top, bottom;
+
+  if (backing) {
+    orange = (SDL_Color){90, 170, 255, 120};
+    trail = (SDL_Color){90, 170, 255, 70};
+    held = -1;
+  }
+
+  for (int i=start; i<=end; i++) {
+    int64_t t = notes->start[i];
+    int pitch = notes->pitch[i];
+    int playing = (t <= now && now < notes->end[i]);
+    int holding = playing && pitch == held;
+    SDL_Color color = holding ? lit : (t <= now) ? dull : trail;
+
+    y = HITLINE - (int)SCROLL_PIXELS(t - now);
+    if (y < -NOTE_HEIGHT) break;    // This and everything after is off screen
+    if (holding) y = HITLINE;
+
+    // Trail from under the head to where the next note's head would be
+    if (notes->flags[i] & NOTE_SUSTAIN) {
+      top = HITLINE - (int)SCROLL_PIXELS(notes->end[i] - now) + NOTE_HEIGHT;
+      bottom = y + NOTE_HEIGHT/2;
+      if (top < 0) top = 0;
+      if (bottom > HEIGHT) bottom = HEIGHT;
+      if (top < y && top < bottom)
+        batchSprite(&sprites, &game_atlas, SPRITE_WHITE,
+                    LANE_X(pitch) + (LANE_WIDTH - SUSTAIN_WIDTH)/2, top,
+                    SUSTAIN_WIDTH, bottom - top, color);
+    }
+
+    if (y < HEIGHT)
+      batchSprite(&sprites, &game_atlas, SPRITE_GEM, LANE_X(pitch),
+                  y, LANE_WIDTH, NOTE_HEIGHT, holding ? lit : orange);
+  }
+}
+
+
+/*==================< scrollParts >==================*
+ * Move each part's first_shown past the notes that  *
+ * have scrolled off the bottom. Cursors only move   *
+ * forward, so over a whole song this looks at each  *
+ * note once, however many parts there are.          *
+ *===================================================*/
+void scrollParts(gamestate *state) {
+  for (int p=0; p<state->num_parts; p++) {
+    partcursor *part = &state->parts[p];
+    while (part->first_shown < part->notes.count &&
+           part->notes.end[part->first_shown] <=
+             state->song_time - SCROLLED_OFF)
+      part->first_shown++;
+  }
+}
+
+
+/*===================< seekParts >===================*
+ * Put every cursor where it belongs at song_time,   *
+ * for a chart that turns up mid-song. Notes already *
+ * past the hit line count as judged.                *
  *===================================================*/
-void drawNotes(note *notes, int start, int end, SDL_Renderer *renderer) {
+void seekParts(gamestate *state) {
+  const notearena *played = &state->parts[state->played_part].notes;
+
+  for (int p=0; p<state->num_parts; p++)
+    state->parts[p].first_shown = findNote(&state->parts[p].notes,
+                                           state->song_time - SCROLLED_OFF);
+  state->next_note = findNote(played, state->song_time);
+  if (state->next_note < played->count &&
+      played->start[state->next_note] <= state->song_time)
+    state->next_note++;
+}
+
+
+/*==================< judgeNotes >===================*
+ * Check each note of the played part as it reaches  *
+ * the hit line: if the player is on its pitch it's  *
+ * a hit, otherwise a miss. Either way the renderer  *
+ * gets an effect. Picks up at the first note not    *
+ * judged yet, so it only ever looks at notes that   *
+ * are due.                                          *
+ *===================================================*/
+void judgeNotes(gamestate *state) {
+  const notearena *notes = &state->parts[state->played_part].notes;
+
+  while (state->next_note < notes->count &&
+         notes->start[state->next_note] <= state->song_time) {
+    int lane = notes->pitch[state->next_note++];
+    int hit = (lane == state->pitchindex);
+    addEffect(state, lane, hit);
+
+    // Every 10 in a row is worth another 100 per note
+    if (hit) {
+      state->combo++;
+      state->score += 100*(1 + state->combo/10);
+    }
+    else {
+      state->combo = 0;
+    }
+  }
+}
+
+
+/*=================< playEffects >==================*
+ * Turn effects newer than *seen into particles.    *
+ * Runs on the render side; effects that already    *
+ * fell out of the snapshot's history are skipped.  *
+ *==================================================*/
+void playEffects(const gamestate *state, Uint32 *seen) {
+  SDL_Color gold = {255, 200, 40, 255};
+  SDL_Color grey = {120, 120, 120, 255};
+  const qualitysettings *q = currentQuality(&quality);
+  Uint32 seq = *seen + 1;
+
+  if (state->effect_seq - *seen > EFFECT_HISTORY)
+    seq = state->effect_seq - EFFECT_HISTORY + 1;
+
+  for (; seq <= state->effect_seq; seq++) {
+    const effect *e = &state->effects[seq%EFFECT_HISTORY];
+    float x = LANE_X(e->lane) + LANE_WIDTH/2;
+    int count = (e->hit ? HIT_PARTICLES : MISS_PARTICLES);
+
+    // Fewer sparks, and a cap on live ones, when the governor says so
+    count = count*q->particle_percent/100;
+    if (count > q->max_particles - particles.count)
+      count = q->max_particles - particles.count;
+    if (count <= 0) continue;
+    if (e->hit)
+      emitParticles(&particles, x, HITLINE, count, gold, 5);
+    else
+      emitParticles(&particles, x, HITLINE, count, grey, 2);
+  }
+  *seen = state->effect_seq;
+}
+
+
+/*=================< endStage >==================*
+ * When benchmarking, flush the queue and the    *
+ * renderer so the stage's work actually         *
+ * happens, and charge the time since the last   *
+ * mark to it.                                   *
+ *===============================================*/
+static void endStage(SDL_Renderer *renderer, double *stage_ms, int stage,
+                     Uint64 *mark) {
+  Uint64 now;
+
+  if (stage_ms == NULL) return;
+  queueBatch(&frame_queue, LAYER_WORLD, &sprites, game_atlas.texture);
+  queueFlush(&frame_queue, renderer);
+  SDL_RenderFlush(renderer);
+  now = SDL_GetPerformanceCounter();
+  stage_ms[stage] += (now - *mark)*1000.0/SDL_GetPerformanceFrequency();
+  *mark = now;
+}
+
+
+/*================< drawBackground >=================*
+ * Clear to the background color for the mode.      *
+ *==================================================*/
+void drawBackground(SDL_Renderer *renderer, const gamestate *state) {
+  // Choose background color
+  SDL_SetRenderDrawColor(renderer, 170, 200, 215, 255);   // Light blue
+  if (state->colorblind) {
+    SDL_SetRenderDrawColor(renderer, 79, 54, 58, 255);    // Dark brown
+  }
+
+  // Set background color
+  SDL_RenderClear(renderer);
+  perf.draw_calls++;
+}
+
+
+/*==================< drawText >====================*
+ * Queue the title message and the name of the      *
+ * pitch being played, from the text cache.         *
+ *==================================================*/
+void drawText(SDL_Renderer *renderer, TTF_Font *font,
+              const gamestate *state) {
+  static const SDL_Color normalFontColor = {50, 170, 255};   // Darker blue
+  static const SDL_Color cbFontColor = {54, 79, 60};        // Weird green
+  SDL_Color fontColor;
+  SDL_Texture *message, *nmessage;
+
+  // Set font color
+  fontColor = normalFontColor;
+  if (state->colorblind) {
+    fontColor = cbFontColor;
+  }
+
+  // Fetch texture (only rasterized when the text changes)
+  message = getTextTexture(renderer, font,
+      state->colorblind ? "Colorblind Mode ;D" : "Theremin Hero!",
+      fontColor);
+
+  /* Shows note on screen */
+  nmessage = getTextTexture(renderer, font,
+                            pitchNames[state->pitchindex], fontColor);
+
+  // Render message texture
+  queueTexture(&frame_queue, LAYER_TEXT, message, &titleRect);
+  queueTexture(&frame_queue, LAYER_TEXT, nmessage, &pitchRect);
+}
+
+
+/*==================< drawScore >===================*
+ * Score, current combo and song time, right-       *
+ * aligned in scoreRect. Composed from the digit    *
+ * atlas: no rasterizing, one run in the queue.     *
+ *==================================================*/
+void drawScore(const gamestate *state) {
+  SDL_Color normal = {5, 42, 100, 255};    // Dark blue
+  SDL_Color cb = {220, 220, 220, 255};     // Light grey on brown
+  SDL_Color color = state->colorblind ? cb : normal;
+  int right = scoreRect.x + scoreRect.w;
+  char buf[24];
+
+  if (score_digits.texture == NULL) return;
+
+  formatNumber(buf, state->score, 7);
+  digitsText(&score_digits, right - digitsWidth(&score_digits, buf),
+             scoreRect.y, buf, color);
+
+  if (state->combo > 1) {
+    buf[0] = 'x';
+    formatNumber(buf+1, state->combo, 1);
+    digitsText(&score_digits, right - digitsWidth(&score_digits, buf),
+               scoreRect.y + SCORE_LINE, buf, color);
+  }
+
+  formatTime(buf, state->song_time > 0 ? state->song_time*60/TIMELINE_RATE
+                                       : 0);
+  digitsText(&score_digits, right - digitsWidth(&score_digits, buf),
+             scoreRect.y + 2*SCORE_LINE, buf, color);
+
+  digitsQueue(&score_digits, &frame_queue, LAYER_TEXT);
+}
+
+
+/*===========< queueLanes, queueNotes, queuePlayer >============*
+ * Put the highway into the sprite batch, flat or perspective.  *
+ * Nothing is drawn until the batch is flushed.                 *
+ *==============================================================*/
+void queueLanes(const gamestate *state) {
+  if (state->perspective)
+    drawHighwayLanes(&sprites, &game_atlas);
+  else
+    drawLaneLines();
+}
+
+void queueNotes(const gamestate *state) {
+  // Backing parts first, so the played one ends up on top
+  for (int i=0; i<=state->num_parts; i++) {
+    int p = (i < state->num_parts) ? i : state->played_part;
+    const partcursor *part = &state->parts[p];
+    int backing = (i < state->num_parts);
+
+    if ((backing && p == state->played_part) ||
+        !(state->shown_parts & (1u << p)) ||
+        part->first_shown == part->notes.count)
+      continue;
+    if (state->perspective)
+      drawHighwayNotes(&sprites, &game_atlas, &part->notes,
+                       part->first_shown, part->notes.count-1,
+                       state->song_time, state->pitchindex, backing);
+    else
+      drawNotes(&part->notes, part->first_shown, part->notes.count-1,
+                state->song_time, state->pitchindex, backing);
+  }
+}
+
+void queuePlayer(const gamestate *state) {
+  if (state->perspective)
+    drawHighwayPlayer(&sprites, &game_atlas, state->pitchindex);
+  else
+    drawNoteRectangle(state->pitchindex);
+}
+
+
+/*=================< renderFrame >==================*
+ * Draw one whole frame, everything short of the    *
+ * present. Shared by the game and the benchmark.   *
+ * After the clear everything goes into frame_queue *
+ * and is drawn sorted at the end. The queue keeps  *
+ * the frame until the next one starts, for the     *
+ * audience window.                                 *
+ *                                                  *
+ * Args:                                            *
+ *   font: title/pitch font (NULL skips the text)   *
+ *   state: game state snapshot to draw             *
+ *   stage_ms: per-stage times to add to, or NULL   *
+ *==================================================*/
+void renderFrame(SDL_Renderer *renderer, TTF_Font *font,
+                 const gamestate *state, double *stage_ms) {
+  Uint64 mark = SDL_GetPerformanceCounter();
+
+  queueClear(&frame_queue);
+
+  /* ========<< Background >>========= */
+  drawBackground(renderer, state);
+  endStage(renderer, stage_ms, STAGE_CLEAR, &mark);
+
+  /* ========<< Song Select >>======== */
+  if (state->menu.active) {
+    menuDraw(&state->menu, &frame_queue);
+    if (state->hud)
+      hudDraw(&frame_queue);
+    queueDraw(&frame_queue, renderer);
+    return;
+  }
+
+  /* ========<< Text >>======== */
+  if (font)
+    drawText(renderer, font, state);
+  drawScore(state);
+  endStage(renderer, stage_ms, STAGE_TEXT, &mark);
+
+  /* ==========<< Draw Lanes >>========== */
+  queueLanes(state);
+  endStage(renderer, stage_ms, STAGE_LANES, &mark);
+
+  /* ==========<< Falling Notes >>========== */
+  queueNotes(state);
+  endStage(renderer, stage_ms, STAGE_NOTES, &mark);
+
+  /* =======<< Rectangle With Current Note >>======= */
+  queuePlayer(state);
+  endStage(renderer, stage_ms, STAGE_PLAYER, &mark);
+
+  /* ==========<< Hit Effects >>========== */
+  drawParticles(&particles, &sprites, &game_atlas);
+
+  // Lanes, notes, player and particles all go out in one draw call
+  queueBatch(&frame_queue, LAYER_WORLD, &sprites, game_atlas.texture);
+  endStage(renderer, stage_ms, STAGE_PARTICLES, &mark);
+
+  /* =========<< Performance HUD >>========= */
+  if (state->hud)
+    hudDraw(&frame_queue);
+  endStage(renderer, stage_ms, STAGE_HUD, &mark);
+
+  // Everything queued goes out now (the benchmark already flushed it)
+  queueDraw(&frame_queue, renderer);
 }
 
 
 
+/*==================< setBacking >==================*
+ * Hand the synth the parts it plays along with:    *
+ * every shown part but the played one, from where  *
+ * live is in the song, which started at audio      *
+ * clock song_zero.                                 *
+ *==================================================*/
+static void setBacking(SDL_AudioDeviceID dev, wavedata *wave,
+                       const gamestate *live, int64_t song_zero) {
+  if (dev) SDL_LockAudioDevice(dev);
+  wave->song_zero = song_zero;
+  wave->num_voices = 0;
+  for (int p=0; p<live->num_parts; p++) {
+    backingvoice *v = &wave->voices[wave->num_voices];
+    if (p == live->played_part || !(live->shown_parts & (1u << p)))
+      continue;
+    v->notes = live->parts[p].notes;
+    v->next = findNote(&v->notes, live->song_time);
+    v->phase = 0;
+    wave->num_voices++;
+  }
+  if (dev) SDL_UnlockAudioDevice(dev);
+}
+
+
+/*=================< pickParts >==================*
+ * Which of song's parts to play (by name; NULL   *
+ * for the first) and which others to show and    *
+ * hear (comma-separated names; NULL for all).    *
+ *================================================*/
+static void pickParts(const chart *song, gamestate *live, const char *play,
+                      const char *others) {
+  live->num_parts = song->num_parts;
+  for (int p=0; p<song->num_parts; p++) {
+    live->parts[p].notes = song->parts[p].notes;
+    live->parts[p].first_shown = 0;
+  }
+
+  live->played_part = play ? findPart(song, play) : 0;
+  if (live->played_part < 0) {
+    printf("No part %s, playing %s\n", play, song->parts[0].name);
+    live->played_part = 0;
+  }
+
+  live->shown_parts = others ? 0 : ~0u;
+  while (others && *others) {
+    char name[PART_NAME_LEN];
+    int len = strcspn(others, ",");
+    int p;
+
+    snprintf(name, sizeof(name), "%.*s", len, others);
+    p = findPart(song, name);
+    if (p >= 0)
+      live->shown_parts |= 1u << p;
+    else
+      printf("No part %s\n", name);
+    others += len + (others[len] == ',');
+  }
+  live->shown_parts |= 1u << live->played_part;
+}
+
+
+/*==================< startSong >===================*
+ * Load the chart at path and play it from the top. *
+ * Returns 0 on success.                            *
+ *==================================================*/
+static int startSong(chart *song, const char *path, gamestate *live,
+                     const char *play, const char *others) {
+  if (loadChart(song, path, 1)) return 1;
+  pickParts(song, live, play, others);
+  live->song_time = 0;
+  live->next_note = 0;
+  live->score = 0;
+  live->combo = 0;
+  live->menu.active = 0;
+  return 0;
+}
+
+
+/*==================< swapSong >===================*
+ * Play fresh, the chart edited on disk, from      *
+ * where the song is now, keeping the score, and   *
+ * free the old chart once nothing is using it.    *
+ *=================================================*/
+static void swapSong(chart *song, reloadedchart *fresh, gamestate *live,
+                     renderthread *render, SDL_AudioDeviceID dev,
+                     wavedata *wave, int64_t song_zero, const char *play,
+                     const char *others) {
+  chart old = *song;
+
+  // The chart moves out of fresh; only its wrapper is freed
+  *song = fresh->song;
+  free(fresh);
+  pickParts(song, live, play, others);
+  seekParts(live);
+  setBacking(dev, wave, live, song_zero);
+  *snapshotBack(render->snapshots) = *live;
+  publishSnapshot(render->snapshots);
+
+  waitForRenderer(render);
+  freeChart(&old);
+}
+
+
+/*==================< dropSong >===================*
+ * Stop playing song and free it, once the synth   *
+ * and the render thread are done with its notes.  *
+ *=================================================*/
+static void dropSong(chart *song, gamestate *live,
+                     renderthread *render, SDL_AudioDeviceID dev,
+                     wavedata *wave) {
+  memset(live->parts, 0, sizeof(live->parts));
+  live->num_parts = 0;
+  live->played_part = 0;
+  setBacking(dev, wave, live, 0);
+  *snapshotBack(render->snapshots) = *live;
+  publishSnapshot(render->snapshots);
+
+  waitForRenderer(render);
+  freeChart(song);
+}
+
+
 /*=============<< main >>==============*
  * Get that party started!             *
  * Initialize for rendering and audio. *
@@ -258,29 +868,85 @@ int main(int argc, char* argv[]) {
   
   // Rendering vars
   SDL_Window *window;
-  SDL_Renderer *renderer;
+  Uint32 window_flags = SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI;
+  int pinned_quality = -1;
+  int show_audience = 0;
   SDL_Event event;
-
-  // Text vars
-  TTF_Font* font;
-  SDL_Surface *surfaceMessage;
-  SDL_Texture *message;
-  SDL_Rect message_rect;
-
-  SDL_Surface *noteMessage;
-  SDL_Texture *nmessage;
-  SDL_Rect nmessage_rect;
+  renderthread render;
+
+  // Game state, and the snapshots of it handed to the render thread
+  gamestate live;
+  static snapshotbuffer snapshots;
+
+  // Song being played, and every song there is to pick from
+  const char *song_path = NULL;
+  const char *play_part = NULL;     // Part to play; NULL for the first
+  const char *other_parts = NULL;   // Parts to show and hear; NULL for all
+  char path[1024];
+  chart song;
+  library songs;
+  songmenu menu;
+  static hotreload reload;          // Picks up edits to the chart and sprites
+  reloadedchart *fresh;
+
+  // Fixed 60 Hz game clock; the song itself follows the audio clock
+  Uint64 tick, next_tick, now, started;
+  int64_t song_zero = 0;      // Audio clock when the song started
+  int stepped;
   
   // Keycode for key presses
   SDL_Keycode key;
 
   /*******<Initial Settings>*******/
 
+  // Command line
+  SDL_memset(&render, 0, sizeof(render));
+  for (int i=1; i<argc; i++) {
+    // Headless render benchmark: ./theremin --bench [frames]
+    if (strcmp(argv[i], "--bench") == 0)
+      return runBenchmark(i+1 < argc ? atoi(argv[i+1]) : BENCH_FRAMES);
+    // Record gameplay: ./theremin --capture out.y4m [--drop-oldest]
+    else if (strcmp(argv[i], "--capture") == 0 && i+1 < argc)
+      render.capture_path = argv[++i];
+    else if (strcmp(argv[i], "--drop-oldest") == 0)
+      render.capture_policy = CAPTURE_DROP_OLDEST;
+    // Forget which render driver was fastest and measure again
+    else if (strcmp(argv[i], "--reprobe") == 0)
+      render.reprobe = 1;
+    // Fill the screen (cabinets); the play area is scaled to fit
+    else if (strcmp(argv[i], "--fullscreen") == 0)
+      window_flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
+    // Fix the quality level instead of adapting: high/medium/low/minimal
+    else if (strcmp(argv[i], "--quality") == 0 && i+1 < argc) {
+      pinned_quality = qualityByName(argv[++i]);
+      if (pinned_quality < 0)
+        printf("Unknown quality %s, adapting instead\n", argv[i]);
+    }
+    // Mirror highway and score to a second window (big screen at events)
+    else if (strcmp(argv[i], "--audience") == 0)
+      show_audience = 1;
+    // Chart to play: ./theremin --song songs/foo.tmn
+    else if (strcmp(argv[i], "--song") == 0 && i+1 < argc)
+      song_path = argv[++i];
+    // Part to play, and which others to play along: --parts harmony,bass
+    else if (strcmp(argv[i], "--part") == 0 && i+1 < argc)
+      play_part = argv[++i];
+    else if (strcmp(argv[i], "--parts") == 0 && i+1 < argc)
+      other_parts = argv[++i];
+  }
+
   // Initialize with appropriate flags
   if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) < 0 ||
       TTF_Init() < 0)
     return 1;
   atexit(SDL_Quit); // Set exit function s.t. SDL resources deallocated on quit
+  initGovernor(&quality, pinned_quality);
+
+  // Find the songs; only charts changed since last launch get read
+  if (loadLibrary(&songs, LIBRARY_DIR) == 0 && songs.rescanned > 0)
+    printf("Indexed %d of %d charts\n", songs.rescanned, songs.num_songs);
+  if (startReload(&reload) == 0)
+    render.reload = &reload;
 
 
 
@@ -296,25 +962,51 @@ int main(int argc, char* argv[]) {
 
   /* ======<< RENDERING SETTINGS >====== */
 
-  // Create window and renderer
+  // Create window; the render thread makes the renderer, font and sprites
   window = SDL_CreateWindow("SDL_RenderClear",
-      SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH, HEIGHT, 0);
-  renderer = SDL_CreateRenderer(window, -1, 0);
+      SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH, HEIGHT,
+      window_flags);
+  if (window && show_audience) {
+    // Fullscreen on the second display if there is one
+    int display = (SDL_GetNumVideoDisplays() > 1) ? 1 : 0;
+    render.audience_window = SDL_CreateWindow("Theremin Hero",
+        SDL_WINDOWPOS_CENTERED_DISPLAY(display),
+        SDL_WINDOWPOS_CENTERED_DISPLAY(display), WIDTH, HEIGHT,
+        SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI |
+        (display ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0));
+    if (render.audience_window == NULL)
+      printf("Error creating audience window: %s\n", SDL_GetError());
+  }
+  initSnapshots(&snapshots);
+  if (window == NULL || startRenderThread(&render, window, &snapshots))
+    return 1;
 
-  /* Text */
+  initHighway();
+  SDL_memset(&live, 0, sizeof(live));
+  SDL_memset(&song, 0, sizeof(song));
+  SDL_memset(&menu, 0, sizeof(menu));
 
-  // Opens font
-  font = TTF_OpenFont("/Library/Fonts/Impact.ttf", 72);
-  if(font == NULL) {
-    printf("Font not found\n");
-    return 1;
+  // Pick from the library, unless the command line already did
+  if (song_path == NULL && songs.num_songs > 0 &&
+      menuInit(&menu, &songs) == 0) {
+    live.menu.active = 1;
+    SDL_StartTextInput();
+  }
+  else {
+    if (song_path == NULL) song_path = "songs/test.tmn";
+    if (startSong(&song, song_path, &live, play_part, other_parts))
+      printf("Playing without a chart\n");
+    else {
+      setBacking(dev, &my_wavedata, &live, 0);
+      watchChart(&reload, song_path);
+    }
   }
-  SDL_Color normalFontColor = {50, 170, 255};   // Darker blue
-  SDL_Color cbFontColor = {54, 79, 60};        // Weird green
-  SDL_Color fontColor = normalFontColor;
-  
+
 
   /*********< Okay, game time! >***********/
+  tick = SDL_GetPerformanceFrequency()/60;
+  next_tick = started = SDL_GetPerformanceCounter();
+  SDL_PauseAudioDevice(dev, 0);
   while (!quit) {
 
     // Get theremin input
@@ -326,90 +1018,106 @@ int main(int argc, char* argv[]) {
         /* Key pressed */
         case SDL_KEYDOWN:
           key = event.key.keysym.sym;
-          checkKey(key, &my_wavedata);
+          if (live.menu.active) {
+            if (key == SDLK_RETURN && menuChoice(&menu) >= 0 &&
+                songPath(&songs, menuChoice(&menu), path, sizeof(path)) == 0 &&
+                startSong(&song, path, &live, play_part, other_parts) == 0) {
+              song_zero = songTime(dev, &have, &my_wavedata, started);
+              setBacking(dev, &my_wavedata, &live, song_zero);
+              watchChart(&reload, path);
+              SDL_StopTextInput();
+            }
+            else if (key == SDLK_ESCAPE && menu.query[0] == '\0')
+              quit = 1;
+            else
+              menuKey(&menu, key);
+          }
+          // Escape goes back to the song list, when there is one
+          else if (key == SDLK_ESCAPE && menu.lib) {
+            watchChart(&reload, NULL);
+            dropSong(&song, &live, &render, dev, &my_wavedata);
+            live.menu.active = 1;
+            SDL_StartTextInput();
+          }
+          else
+            checkKey(key, &my_wavedata);
+          break;
+        /* Typed text, for the song search */
+        case SDL_TEXTINPUT:
+          if (live.menu.active)
+            menuType(&menu, event.text.text);
           break;
         /* Exit */
         case SDL_QUIT:
           quit = 1;
           break;
+        /* With two windows, closing one doesn't send SDL_QUIT */
+        case SDL_WINDOWEVENT:
+          if (event.window.event != SDL_WINDOWEVENT_CLOSE)
+            break;
+          if (event.window.windowID == SDL_GetWindowID(window))
+            quit = 1;
+          else if (render.audience_window)
+            SDL_HideWindow(render.audience_window);
+          break;
         default:
           break;
       }
     }
 
-    /* ========<< Text >>======== */
-
-    // Set font color
-    fontColor = normalFontColor;
-    if (colorblind) {
-      fontColor = cbFontColor;
-    }
-    
-    // Create surface and convert it to texture
-    surfaceMessage =
-      TTF_RenderText_Solid(font, "Theremin Hero!", fontColor);
-    if (colorblind) {
-      surfaceMessage =
-        TTF_RenderText_Solid(font, "Colorblind Mode ;D", fontColor);
+    /* ========<< Simulation >>======== */
+
+    // The chart was edited: carry on in the new one, same place in the song
+    if ((fresh = takeReload(&reload)) != NULL)
+      swapSong(&song, fresh, &live, &render, dev, &my_wavedata, song_zero,
+               play_part, other_parts);
+
+    // Step the game in whole 60 Hz frames, however long rendering takes
+    now = SDL_GetPerformanceCounter();
+    if (now - next_tick > 10*tick && now > next_tick)
+      next_tick = now;        // Way behind (debugger, suspend): don't spiral
+    stepped = 0;
+    while (now >= next_tick) {
+      live.frame = frame_cntr;
+      live.song_time = songTime(dev, &have, &my_wavedata, started) -
+                       song_zero;
+      live.pitchindex = my_wavedata.pitchindex;
+      scrollParts(&live);
+      judgeNotes(&live);
+
+      // Update frame counter
+      frame_cntr++;
+      next_tick += tick;
+      stepped = 1;
     }
-    message = SDL_CreateTextureFromSurface(renderer, surfaceMessage);
-
-    // {xPos, yPos, width, height}
-    message_rect.x = 150;
-    message_rect.y = 200;
-    message_rect.w = 200;
-    message_rect.h = 80;
-
-    /* Shows note on screen */
-    noteMessage =
-      TTF_RenderText_Solid(font, pitchNames[my_wavedata.pitchindex], fontColor);
-    nmessage = SDL_CreateTextureFromSurface(renderer, noteMessage);
 
-    nmessage_rect.x = 210;
-    nmessage_rect.y = 350;
-    nmessage_rect.w = 100;
-    nmessage_rect.h = 50;
-
-
-    /* ========<< Background >>========= */
-
-    // Choose background color
-    SDL_SetRenderDrawColor(renderer, 170, 200, 215, 255);   // Light blue
-    if (colorblind) {
-      SDL_SetRenderDrawColor(renderer, 79, 54, 58, 255);    // Dark brown
+    /* ========<< Hand Off To Renderer >>======== */
+    if (stepped) {
+      if (live.menu.active)
+        menuView(&menu, &live.menu);
+      live.colorblind = colorblind;
+      live.perspective = perspective;
+      live.hud = hud_visible;
+      *snapshotBack(&snapshots) = live;
+      publishSnapshot(&snapshots);
     }
+#ifdef RENDER_ON_MAIN
+    pumpRenderer(&render);    // No render thread here: draw the new snapshot
+#endif
 
-    // Set background color
-    SDL_RenderClear(renderer);
-
-    // Render message texture
-    SDL_RenderCopy(renderer, message, NULL, &message_rect);
-    SDL_RenderCopy(renderer, nmessage, NULL, &nmessage_rect);
-
-    /* ==========<< Draw Lanes >>========== */
-    drawLaneLines(renderer);
-
-    /* =======<< Rectangle With Current Note >>======= */
-    drawNoteRectangle(my_wavedata.pitchindex, renderer);
-
-    // Move to foreground
-    SDL_RenderPresent(renderer);
-
-    /* =========<< Audio >>========== */
-    SDL_PauseAudioDevice(dev, mute);
-
-    // Update frame counter
-    frame_cntr++;
+    // Check input again in a millisecond
+    SDL_Delay(1);
   }
 
   // CLEAN YO' ROOM (Cleanup)
-  TTF_CloseFont(font);
+  stopRenderThread(&render);
+  stopReload(&reload);
+  if (render.audience_window) SDL_DestroyWindow(render.audience_window);
+  freeChart(&song);
+  menuFree(&menu);
+  freeLibrary(&songs);
   SDL_CloseAudioDevice(dev);
   SDL_Quit();
 
   return 0;
 }
-
-
-
-
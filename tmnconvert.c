@@ -0,0 +1,28 @@
+/*=======================*
+ |    Chart Compiler     |
+ *=======================*/
+
+/* Turns a text chart into the binary one the game loads without
+ * parsing. make tmnc runs it for every chart in songs/:
+ *
+ *   ./tmnconvert songs/foo.tmn songs/foo.tmnb
+ */
+
+#include <stdio.h>
+
+#include "chart.h"
+
+int main(int argc, char* argv[]) {
+  chart c;
+  int status;
+
+  if (argc != 3) {
+    printf("usage: %s in.tmn out.tmnb\n", argv[0]);
+    return 1;
+  }
+  if (loadChart(&c, argv[1], 0))
+    return 1;
+  status = saveChartBinary(&c, argv[2]);
+  freeChart(&c);
+  return status;
+}